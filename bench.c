@@ -0,0 +1,276 @@
+/*
+ * bench.c: Throughput benchmarks for the recording hot path
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "recording.h"
+#include "remux.h"
+#include "ringbuffer.h"
+#include "synthdevice.h"
+#include "tools.h"
+
+// The benchmark defines its own malloc(), calloc() and realloc(), which take
+// the place of the C library's functions for the entire program (the same
+// way a malloc library loaded through LD_PRELOAD would), and hand the actual
+// work to the C library's allocator. This way every allocation is counted,
+// including those made inside the C library (strdup(), asprintf(),
+// open_memstream() etc.) and by 'operator new'. Memory obtained through
+// posix_memalign() and mmap() is not counted.
+
+static volatile int Allocations = 0;
+
+extern "C" {
+void *__libc_malloc(size_t Size);
+void *__libc_calloc(size_t Count, size_t Size);
+void *__libc_realloc(void *Ptr, size_t Size);
+
+void *malloc(size_t Size)
+{
+  Allocations++;
+  return __libc_malloc(Size);
+}
+
+void *calloc(size_t Count, size_t Size)
+{
+  Allocations++;
+  return __libc_calloc(Count, Size);
+}
+
+void *realloc(void *Ptr, size_t Size)
+{
+  Allocations++;
+  return __libc_realloc(Ptr, Size);
+}
+}
+
+// --- Benchmarks ------------------------------------------------------------
+
+static double Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(const char *Name, cSynthStream *Stream, int Loops, double Seconds, int Allocs)
+{
+  double Bytes = double(Stream->Length()) * Loops;
+  double Packets = double(Stream->Packets()) * Loops;
+  printf("  %-16s %9.1f MB/s %12.0f packets/s %8.4f allocs/packet\n", Name, Bytes / MEGABYTE(1) / Seconds, Packets / Seconds, Allocs / Packets);
+}
+
+static double BenchRemux(cSynthStream *Stream, int Loops, bool Threaded, int &Frames, int ExpectedFrames = 0)
+{
+  // Same thread for Put() and Get(), as recommended in remux.h. At the end,
+  // the threaded remuxer is polled until it has delivered ExpectedFrames, and
+  // the time at which it delivered its last data is returned, so that waiting
+  // for a worker that has nothing more to deliver isn't counted:
+  cRemux Remux(Stream->Vpid(), Stream->Apids(), Stream->Dpids(), NULL, false, Threaded);
+  Remux.SetTimeouts(0, 0);
+  Frames = 0;
+  double Done = 0;
+  for (int Loop = 0; Loop < Loops; Loop++) {
+      const uchar *Data = Stream->Data();
+      int Count = Stream->Length();
+      int Idle = 0;
+      bool Last = Loop == Loops - 1;
+      while (Count > 0 || Last && Idle < 100 && (!ExpectedFrames || Frames < ExpectedFrames)) {
+            if (Count > 0) {
+               int n = Remux.Put(Data, min(Count, KILOBYTE(64)));
+               Data += n;
+               Count -= n;
+               }
+            int r;
+            uchar PictureType;
+            uchar *p = Remux.Get(r, &PictureType);
+            if (p) {
+               if (PictureType != NO_PICTURE)
+                  Frames++;
+               Remux.Del(r);
+               Idle = 0;
+               }
+            if (Last && Count <= 0 && (p || !Done))
+               Done = Now();
+            if (!p && Count <= 0) {
+               if (!Threaded)
+                  break;
+               Idle++; // let the worker finish
+               cCondWait::SleepMs(1);
+               }
+            }
+      }
+  return Done;
+}
+
+static void BenchRingBuffer(cSynthStream *Stream, int Loops)
+{
+  // Like cRecorder::Receive() and cRecorder::Action(), but in one thread:
+  cRingBufferLinear RingBuffer(MEGABYTE(5), TS_SIZE * 2, true, "Bench");
+  RingBuffer.SetTimeouts(0, 0);
+  for (int Loop = 0; Loop < Loops; Loop++) {
+      const uchar *Data = Stream->Data();
+      for (int i = 0; i < Stream->Length(); i += TS_SIZE) {
+          if (RingBuffer.Free() < TS_SIZE) {
+             int r;
+             while (RingBuffer.Get(r))
+                   RingBuffer.Del(r);
+             }
+          RingBuffer.Put(Data + i, TS_SIZE);
+          }
+      int r;
+      while (RingBuffer.Get(r))
+            RingBuffer.Del(r);
+      }
+}
+
+static bool BenchIndex(const char *Directory, int Frames)
+{
+  cIndexFile Index(Directory, true);
+  for (int i = 0; i < Frames; i++) {
+      if (!Index.Write(i % 12 ? B_FRAME : I_FRAME, 1, i * KILOBYTE(20)))
+         return false;
+      }
+  return true;
+}
+
+static bool BenchFile(const char *Directory, cSynthStream *Stream, int Loops)
+{
+  // Like cFileWriter in recorder.c:
+  cString FileName = cString::sprintf("%s/001.ts", Directory);
+  cUnbufferedFile *f = cUnbufferedFile::Create(FileName, O_RDWR | O_CREAT | O_TRUNC);
+  if (!f)
+     return false;
+  f->SetWriteBehind(8, KILOBYTE(512), FileName);
+  bool Ok = true;
+  for (int Loop = 0; Ok && Loop < Loops; Loop++) {
+      for (int i = 0; Ok && i < Stream->Length(); i += KILOBYTE(64))
+          Ok = f->Write(Stream->Data() + i, min(KILOBYTE(64), Stream->Length() - i)) >= 0;
+      }
+  if (f->Close() < 0)
+     Ok = false;
+  delete f;
+  return Ok;
+}
+
+static void Bench(cSynthStream *Stream, int Loops, const char *Directory)
+{
+  printf("%s: %.1f MB, %d packets, %d loops\n", Stream->Name(), double(Stream->Length()) / MEGABYTE(1), Stream->Packets(), Loops);
+  int Frames = 0;
+  int a = Allocations;
+  double t = Now();
+  double Done = BenchRemux(Stream, Loops, false, Frames);
+  Report("cRemux", Stream, Loops, Done - t, Allocations - a);
+  if (!Frames)
+     printf("  ERROR: the remuxer didn't deliver any frames\n");
+  if (Stream->Vpid() && sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+     int ThreadedFrames = 0;
+     a = Allocations;
+     t = Now();
+     Done = BenchRemux(Stream, Loops, true, ThreadedFrames, Frames);
+     Report("cRemux threaded", Stream, Loops, Done - t, Allocations - a);
+     if (ThreadedFrames != Frames)
+        printf("  ERROR: threaded remuxer delivered %d frames instead of %d\n", ThreadedFrames, Frames);
+     }
+  a = Allocations;
+  t = Now();
+  BenchRingBuffer(Stream, Loops);
+  Report("cRingBuffer", Stream, Loops, Now() - t, Allocations - a);
+  a = Allocations;
+  t = Now();
+  if (BenchIndex(Directory, Frames)) {
+     double s = Now() - t;
+     printf("  %-16s %9.0f entries/s %8.4f allocs/entry (%d entries)\n", "cIndexFile", Frames / s, Frames ? double(Allocations - a) / Frames : 0.0, Frames);
+     }
+  else
+     printf("  ERROR: can't write index in %s\n", Directory);
+  a = Allocations;
+  t = Now();
+  if (BenchFile(Directory, Stream, Loops))
+     Report("cUnbufferedFile", Stream, Loops, Now() - t, Allocations - a);
+  else
+     printf("  ERROR: can't write file in %s\n", Directory);
+  RemoveFileOrDir(cString::sprintf("%s/001.ts", Directory));
+  RemoveFileOrDir(cString::sprintf("%s/index.vdr", Directory));
+}
+
+int main(int argc, char *argv[])
+{
+  int Loops = 3;
+  int Seconds = 30;
+  const char *Directory = "/tmp";
+
+  static struct option long_options[] = {
+      { "dir",     required_argument, NULL, 'd' },
+      { "loops",   required_argument, NULL, 'l' },
+      { "seconds", required_argument, NULL, 's' },
+      { "help",    no_argument,       NULL, 'h' },
+      { NULL,      no_argument,       NULL,  0  }
+    };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "d:l:s:h", long_options, NULL)) != -1) {
+        switch (c) {
+          case 'd': Directory = optarg;
+                    break;
+          case 'l': Loops = max(atoi(optarg), 1);
+                    break;
+          case 's': Seconds = max(atoi(optarg), 1);
+                    break;
+          default:  printf("Usage: vdr-bench [OPTIONS] [FILE...]\n\n"
+                           "  -d DIR,   --dir=DIR      write the test files into a temporary\n"
+                           "                           directory in DIR (default: /tmp)\n"
+                           "  -l NUM,   --loops=NUM    process each stream NUM times (default: 3)\n"
+                           "  -s SEC,   --seconds=SEC  length of the generated streams (default: 30)\n"
+                           "  -h,       --help         print this help and exit\n"
+                           "\n"
+                           "Each FILE must be a transport stream with a PAT and a PMT, like the\n"
+                           "files of a TS recording. Without any FILE, SD, HD and AC3 test streams\n"
+                           "are generated.\n");
+                    return c == 'h' ? 0 : 2;
+          }
+        }
+
+  cString Temp = cString::sprintf("%s/vdr-bench-XXXXXX", Directory);
+  char *TempDir = strdup(Temp);
+  if (!mkdtemp(TempDir)) {
+     LOG_ERROR_STR(TempDir);
+     fprintf(stderr, "can't create a directory in %s\n", Directory);
+     return 1;
+     }
+
+  int Result = 0;
+  if (optind < argc) {
+     for (int i = optind; i < argc; i++) {
+         cSynthStream Stream(argv[i]);
+         if (Stream.Load(argv[i], 256))
+            Bench(&Stream, Loops, TempDir);
+         else {
+            fprintf(stderr, "vdr-bench: can't load %s\n", argv[i]);
+            Result = 1;
+            }
+         }
+     }
+  else {
+     cSynthStream Sd("SD");
+     if (Sd.Generate(Seconds, 4000000, true, false))
+        Bench(&Sd, Loops, TempDir);
+     cSynthStream Hd("HD");
+     if (Hd.Generate(Seconds, 16000000, true, true))
+        Bench(&Hd, Loops, TempDir);
+     cSynthStream Ac3("AC3");
+     if (Ac3.Generate(Seconds, 0, false, true))
+        Bench(&Ac3, Loops, TempDir);
+     }
+
+  RemoveFileOrDir(TempDir, true);
+  free(TempDir);
+  return Result;
+}
@@ -277,6 +277,7 @@ cSetup::cSetup(void)
   FontFixSize = 20;
   MaxVideoFileSize = MAXVIDEOFILESIZE;
   SplitEditedFiles = 0;
+  UseTsRecording = 0;
   MinEventTimeout = 30;
   MinUserInactivity = 300;
   NextWakeupTime = 0;
@@ -290,6 +291,8 @@ cSetup::cSetup(void)
   InitialVolume = -1;
   EmergencyExit = 1;
   RecorderBufSize = 100;
+  RecorderBufBudget = 200;
+  MetricsLogInterval = 0;
 }
 
 cSetup& cSetup::operator= (const cSetup &s)
@@ -451,6 +454,7 @@ bool cSetup::Parse(const char *Name, const char *Value)
   else if (!strcasecmp(Name, "FontFixSize"))         FontFixSize        = atoi(Value);
   else if (!strcasecmp(Name, "MaxVideoFileSize"))    MaxVideoFileSize   = atoi(Value);
   else if (!strcasecmp(Name, "SplitEditedFiles"))    SplitEditedFiles   = atoi(Value);
+  else if (!strcasecmp(Name, "UseTsRecording"))      UseTsRecording     = atoi(Value);
   else if (!strcasecmp(Name, "MinEventTimeout"))     MinEventTimeout    = atoi(Value);
   else if (!strcasecmp(Name, "MinUserInactivity"))   MinUserInactivity  = atoi(Value);
   else if (!strcasecmp(Name, "NextWakeupTime"))      NextWakeupTime     = atoi(Value);
@@ -464,6 +468,8 @@ bool cSetup::Parse(const char *Name, const char *Value)
   else if (!strcasecmp(Name, "InitialVolume"))       InitialVolume      = atoi(Value);
   else if (!strcasecmp(Name, "EmergencyExit"))       EmergencyExit      = atoi(Value);
   else if (!strcasecmp(Name, "RecorderBufSize"))     RecorderBufSize    = atoi(Value);
+  else if (!strcasecmp(Name, "RecorderBufBudget"))   RecorderBufBudget  = atoi(Value);
+  else if (!strcasecmp(Name, "MetricsLogInterval"))  MetricsLogInterval = atoi(Value);
   else
      return false;
   return true;
@@ -535,6 +541,7 @@ bool cSetup::Save(void)
   Store("FontFixSize",        FontFixSize);
   Store("MaxVideoFileSize",   MaxVideoFileSize);
   Store("SplitEditedFiles",   SplitEditedFiles);
+  Store("UseTsRecording",     UseTsRecording);
   Store("MinEventTimeout",    MinEventTimeout);
   Store("MinUserInactivity",  MinUserInactivity);
   Store("NextWakeupTime",     NextWakeupTime);
@@ -548,6 +555,8 @@ bool cSetup::Save(void)
   Store("InitialVolume",      InitialVolume);
   Store("EmergencyExit",      EmergencyExit);
   Store("RecorderBufSize",    RecorderBufSize);
+  Store("RecorderBufBudget",  RecorderBufBudget);
+  Store("MetricsLogInterval", MetricsLogInterval);
 
   Sort();
 
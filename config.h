@@ -256,6 +256,7 @@ public:
   int FontFixSize;
   int MaxVideoFileSize;
   int SplitEditedFiles;
+  int UseTsRecording;
   int MinEventTimeout, MinUserInactivity;
   time_t NextWakeupTime;
   int MultiSpeedMode;
@@ -268,6 +269,8 @@ public:
   int InitialVolume;
   int EmergencyExit;
   int RecorderBufSize;
+  int RecorderBufBudget;
+  int MetricsLogInterval;
   int __EndData__;
   cSetup(void);
   cSetup& operator= (const cSetup &s);
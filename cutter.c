@@ -15,6 +15,17 @@
 
 // --- cCuttingThread --------------------------------------------------------
 
+// Frames are read from the original recording in blocks of this size:
+#define CUTTERBLOCKSIZE     MEGABYTE(4)
+
+// The edited version is written asynchronously, so that reading the next
+// block overlaps with writing the previous one:
+#define CUTTERWRITEBUFFERS  4
+#define CUTTERWRITEBUFSIZE  MEGABYTE(1)
+
+// The number of index entries that are written to disk in one go:
+#define CUTTERINDEXBUFFER   1000
+
 class cCuttingThread : public cThread {
 private:
   const char *error;
@@ -22,12 +33,14 @@ private:
   cFileName *fromFileName, *toFileName;
   cIndexFile *fromIndex, *toIndex;
   cMarks fromMarks, toMarks;
+  int64_t written; // the number of bytes written to the edited version
 protected:
   virtual void Action(void);
 public:
   cCuttingThread(const char *FromFileName, const char *ToFileName);
   virtual ~cCuttingThread();
   const char *Error(void) { return error; }
+  int SizeMB(void) { return int(written / MEGABYTE(1)); }
   };
 
 cCuttingThread::cCuttingThread(const char *FromFileName, const char *ToFileName)
@@ -37,9 +50,10 @@ cCuttingThread::cCuttingThread(const char *FromFileName, const char *ToFileName)
   fromFile = toFile = NULL;
   fromFileName = toFileName = NULL;
   fromIndex = toIndex = NULL;
+  written = 0;
   if (fromMarks.Load(FromFileName) && fromMarks.Count()) {
      fromFileName = new cFileName(FromFileName, false, true);
-     toFileName = new cFileName(ToFileName, true, true);
+     toFileName = new cFileName(ToFileName, true, true, fromFileName->IsTs());
      fromIndex = new cIndexFile(FromFileName, false);
      toIndex = new cIndexFile(ToFileName, true);
      toMarks.Load(ToFileName); // doesn't actually load marks, just sets the file name
@@ -67,6 +81,8 @@ void cCuttingThread::Action(void)
      if (!fromFile || !toFile)
         return;
      fromFile->SetReadAhead(MEGABYTE(20));
+     toFile->SetWriteBehind(CUTTERWRITEBUFFERS, CUTTERWRITEBUFSIZE, toFileName->Name());
+     toIndex->SetWriteBuffer(CUTTERINDEXBUFFER);
      int Index = Mark->position;
      Mark = fromMarks.Next(Mark);
      int FileSize = 0;
@@ -74,40 +90,66 @@ void cCuttingThread::Action(void)
      int LastIFrame = 0;
      toMarks.Add(0);
      toMarks.Save();
-     uchar buffer[MAXFRAMESIZE];
+     uchar *block = MALLOC(uchar, CUTTERBLOCKSIZE);
+     if (!block) {
+        error = "block";
+        return;
+        }
+     int BlockFileNumber = 0;
+     int BlockOffset = 0;
+     int BlockLength = 0;
      bool LastMark = false;
      bool cutIn = true;
      while (Running()) {
            uchar FileNumber;
            int FileOffset, Length;
            uchar PictureType;
+           uchar *buffer;
 
            // Make sure there is enough disk space:
 
            AssertFreeDiskSpace(-1);
 
-           // Read one frame:
+           // Get one frame (reading a new block if necessary):
 
            if (fromIndex->Get(Index++, &FileNumber, &FileOffset, &PictureType, &Length)) {
-              if (FileNumber != CurrentFileNumber) {
-                 fromFile = fromFileName->SetOffset(FileNumber, FileOffset);
-                 fromFile->SetReadAhead(MEGABYTE(20));
-                 CurrentFileNumber = FileNumber;
-                 }
-              if (fromFile) {
-                 int len = ReadFrame(fromFile, buffer,  Length, sizeof(buffer));
+              bool BlockEof = BlockLength < CUTTERBLOCKSIZE; // a short block ends at the end of the file
+              if (FileNumber != BlockFileNumber || FileOffset < BlockOffset || (Length < 0 ? !BlockEof : FileOffset + Length > BlockOffset + BlockLength)) {
+                 // The part of the block the frame starts in is kept, and the
+                 // rest is read from where the previous read ended, so that
+                 // there is only a seek at editing marks and file changes:
+                 int Keep = 0;
+                 if (FileNumber == CurrentFileNumber && FileNumber == BlockFileNumber && FileOffset >= BlockOffset && FileOffset <= BlockOffset + BlockLength && !BlockEof)
+                    Keep = BlockOffset + BlockLength - FileOffset;
+                 else {
+                    fromFile = fromFileName->SetOffset(FileNumber, FileOffset);
+                    if (fromFile)
+                       fromFile->SetReadAhead(MEGABYTE(20));
+                    CurrentFileNumber = FileNumber;
+                    }
+                 if (!fromFile) {
+                    error = "fromFile";
+                    break;
+                    }
+                 if (Keep)
+                    memmove(block, block + FileOffset - BlockOffset, Keep);
+                 int len = ReadFrame(fromFile, block + Keep, CUTTERBLOCKSIZE - Keep, CUTTERBLOCKSIZE - Keep);
                  if (len < 0) {
                     error = "ReadFrame";
                     break;
                     }
-                 if (len != Length) {
-                    CurrentFileNumber = 0; // this re-syncs in case the frame was larger than the buffer
-                    Length = len;
-                    }
+                 BlockFileNumber = FileNumber;
+                 BlockOffset = FileOffset;
+                 BlockLength = Keep + len;
                  }
-              else {
-                 error = "fromFile";
-                 break;
+              buffer = block + FileOffset - BlockOffset;
+              int Available = BlockOffset + BlockLength - FileOffset;
+              if (Length < 0) // this means "everything up to EOF" (see cIndexFile)
+                 Length = Available;
+              else if (Length > Available) {
+                 esyslog("ERROR: can't read frame at offset %d of file #%d (%d < %d)", FileOffset, FileNumber, Available, Length);
+                 BlockFileNumber = CurrentFileNumber = 0; // this re-syncs in case the frame was larger than the block
+                 Length = Available;
                  }
               }
            else {
@@ -128,12 +170,17 @@ void cCuttingThread::Action(void)
                     error = "toFile 1";
                     break;
                     }
+                 toFile->SetWriteBehind(CUTTERWRITEBUFFERS, CUTTERWRITEBUFSIZE, toFileName->Name());
+                 written += FileSize;
                  FileSize = 0;
                  }
               LastIFrame = 0;
 
               if (cutIn) {
-                 cRemux::SetBrokenLink(buffer, Length);
+                 if (fromFileName->IsTs())
+                    TsSetBrokenLink(buffer, Length);
+                 else
+                    cRemux::SetBrokenLink(buffer, Length);
                  cutIn = false;
                  }
               }
@@ -156,6 +203,7 @@ void cCuttingThread::Action(void)
               toMarks.Add(LastIFrame);
               if (Mark)
                  toMarks.Add(toIndex->Last() + 1);
+              toIndex->Flush();
               toMarks.Save();
               if (Mark) {
                  Index = Mark->position;
@@ -168,6 +216,8 @@ void cCuttingThread::Action(void)
                        error = "toFile 2";
                        break;
                        }
+                    toFile->SetWriteBehind(CUTTERWRITEBUFFERS, CUTTERWRITEBUFSIZE, toFileName->Name());
+                    written += FileSize;
                     FileSize = 0;
                     }
                  }
@@ -175,6 +225,9 @@ void cCuttingThread::Action(void)
                  LastMark = true;
               }
            }
+     free(block);
+     written += FileSize;
+     toIndex->Flush();
      Recordings.TouchUpdate();
      }
   else
@@ -240,6 +293,8 @@ bool cCutter::Active(void)
      if (cuttingThread->Active())
         return true;
      error = cuttingThread->Error();
+     if (!error)
+        Recordings.SetFileSizeMB(editedVersionName, cuttingThread->SizeMB());
      Stop();
      if (!error)
         cRecordingUserCommand::InvokeCommand(RUC_EDITEDRECORDING, editedVersionName);
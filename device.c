@@ -14,6 +14,7 @@
 #include "audio.h"
 #include "channels.h"
 #include "i18n.h"
+#include "metrics.h"
 #include "player.h"
 #include "receiver.h"
 #include "status.h"
@@ -30,6 +31,7 @@ private:
 protected:
   virtual void Activate(bool On);
   virtual void Receive(uchar *Data, int Length);
+  virtual void ReceiveBatch(uchar **Data, int Count) { ReceiveContiguous(Data, Count); }
   virtual void Action(void);
 public:
   cLiveSubtitle(int SPid);
@@ -41,6 +43,7 @@ cLiveSubtitle::cLiveSubtitle(int SPid)
 ,cThread("live subtitle")
 {
   ringBuffer = new cRingBufferLinear(LIVESUBTITLEBUFSIZE, TS_SIZE * 2, true, "Live Subtitle");
+  ringBuffer->SetSingleProducerConsumer();
   int NoPids = 0;
   int SPids[] = { SPid, 0 };
   remux = new cRemux(0, &NoPids, &NoPids, SPids);
@@ -252,6 +255,9 @@ cDevice::cDevice(void)
 
   for (int i = 0; i < MAXRECEIVERS; i++)
       receiver[i] = NULL;
+  memset(receiverMask, 0, sizeof(receiverMask));
+  receivedPackets = new cMetricCounter(cString::sprintf("device%d.packets_received", CardIndex() + 1));
+  distributedPackets = new cMetricCounter(cString::sprintf("device%d.packets_distributed", CardIndex() + 1));
 
   if (numDevices < MAXDEVICES)
      device[numDevices++] = this;
@@ -266,6 +272,8 @@ cDevice::~cDevice()
   delete liveSubtitle;
   delete dvbSubtitleConverter;
   delete pesAssembler;
+  delete receivedPackets;
+  delete distributedPackets;
 }
 
 bool cDevice::WaitForAllDevicesReady(int Timeout)
@@ -1422,46 +1430,67 @@ bool cDevice::Receiving(bool CheckAny) const
 void cDevice::Action(void)
 {
   if (Running() && OpenDvr()) {
+     uchar *Batch[MAXRECEIVERS][MAXTSBATCH];
+     int BatchCount[MAXRECEIVERS];
      while (Running()) {
            // Read data from the DVR device:
-           uchar *b = NULL;
-           if (GetTSPacket(b)) {
-              if (b) {
-                 int Pid = (((uint16_t)b[1] & PID_MASK_HI) << 8) | b[2];
-                 // Check whether the TS packets are scrambled:
-                 bool DetachReceivers = false;
-                 bool DescramblingOk = false;
-                 int CamSlotNumber = 0;
-                 if (startScrambleDetection) {
-                    cCamSlot *cs = CamSlot();
-                    CamSlotNumber = cs ? cs->SlotNumber() : 0;
-                    if (CamSlotNumber) {
-                       bool Scrambled = b[3] & TS_SCRAMBLING_CONTROL;
-                       int t = time(NULL) - startScrambleDetection;
-                       if (Scrambled) {
-                          if (t > TS_SCRAMBLING_TIMEOUT)
-                             DetachReceivers = true;
-                          }
-                       else if (t > TS_SCRAMBLING_TIME_OK) {
-                          DescramblingOk = true;
-                          startScrambleDetection = 0;
-                          }
-                       }
-                    }
-                 // Distribute the packet to all attached receivers:
+           uchar *Data = NULL;
+           int Count = 0;
+           if (GetTSPackets(Data, Count, MAXTSBATCH)) {
+              if (Data) {
+                 receivedPackets->Add(Count);
+                 memset(BatchCount, 0, sizeof(BatchCount));
                  Lock();
-                 for (int i = 0; i < MAXRECEIVERS; i++) {
-                     if (receiver[i] && receiver[i]->WantsPid(Pid)) {
-                        if (DetachReceivers) {
-                           ChannelCamRelations.SetChecked(receiver[i]->ChannelID(), CamSlotNumber);
-                           Detach(receiver[i]);
+                 for (int n = 0; n < Count; n++) {
+                     uchar *b = Data + n * TS_SIZE;
+                     int Pid = (((uint16_t)b[1] & PID_MASK_HI) << 8) | b[2];
+                     // Check whether the TS packets are scrambled:
+                     bool DetachReceivers = false;
+                     bool DescramblingOk = false;
+                     int CamSlotNumber = 0;
+                     if (startScrambleDetection) {
+                        cCamSlot *cs = CamSlot();
+                        CamSlotNumber = cs ? cs->SlotNumber() : 0;
+                        if (CamSlotNumber) {
+                           bool Scrambled = b[3] & TS_SCRAMBLING_CONTROL;
+                           int t = time(NULL) - startScrambleDetection;
+                           if (Scrambled) {
+                              if (t > TS_SCRAMBLING_TIMEOUT)
+                                 DetachReceivers = true;
+                              }
+                           else if (t > TS_SCRAMBLING_TIME_OK) {
+                              DescramblingOk = true;
+                              startScrambleDetection = 0;
+                              }
                            }
-                        else
-                           receiver[i]->Receive(b, TS_SIZE);
-                        if (DescramblingOk)
-                           ChannelCamRelations.SetDecrypt(receiver[i]->ChannelID(), CamSlotNumber);
+                        }
+                     // Collect the packet for all attached receivers that want it:
+                     uint32_t Mask = receiverMask[Pid];
+                     for (int i = 0; Mask; i++, Mask >>= 1) {
+                         if ((Mask & 1) && receiver[i]) {
+                            if (DetachReceivers) {
+                               if (BatchCount[i])
+                                  receiver[i]->ReceiveBatch(Batch[i], BatchCount[i]);
+                               BatchCount[i] = 0;
+                               ChannelCamRelations.SetChecked(receiver[i]->ChannelID(), CamSlotNumber);
+                               Detach(receiver[i]);
+                               }
+                            else
+                               Batch[i][BatchCount[i]++] = b;
+                            if (DescramblingOk)
+                               ChannelCamRelations.SetDecrypt(receiver[i]->ChannelID(), CamSlotNumber);
+                            }
+                         }
+                     }
+                 // Distribute the packets to the receivers:
+                 int Distributed = 0;
+                 for (int i = 0; i < MAXRECEIVERS; i++) {
+                     if (BatchCount[i] && receiver[i]) {
+                        receiver[i]->ReceiveBatch(Batch[i], BatchCount[i]);
+                        Distributed += BatchCount[i];
                         }
                      }
+                 distributedPackets->Add(Distributed);
                  Unlock();
                  }
               }
@@ -1486,6 +1515,17 @@ bool cDevice::GetTSPacket(uchar *&Data)
   return false;
 }
 
+bool cDevice::GetTSPackets(uchar *&Data, int &Count, int MaxCount)
+{
+  Count = 0;
+  if (GetTSPacket(Data)) {
+     if (Data)
+        Count = 1;
+     return true;
+     }
+  return false;
+}
+
 bool cDevice::AttachReceiver(cReceiver *Receiver)
 {
   if (!Receiver)
@@ -1515,6 +1555,7 @@ bool cDevice::AttachReceiver(cReceiver *Receiver)
          Lock();
          Receiver->device = this;
          receiver[i] = Receiver;
+         SetReceiverMask(Receiver, i, true);
          Unlock();
          if (camSlot) {
             camSlot->StartDecrypting();
@@ -1538,6 +1579,7 @@ void cDevice::Detach(cReceiver *Receiver)
       if (receiver[i] == Receiver) {
          Receiver->Activate(false);
          Lock();
+         SetReceiverMask(Receiver, i, false);
          receiver[i] = NULL;
          Receiver->device = NULL;
          Unlock();
@@ -1557,14 +1599,28 @@ void cDevice::DetachAll(int Pid)
 {
   if (Pid) {
      cMutexLock MutexLock(&mutexReceiver);
-     for (int i = 0; i < MAXRECEIVERS; i++) {
-         cReceiver *Receiver = receiver[i];
-         if (Receiver && Receiver->WantsPid(Pid))
-            Detach(Receiver);
+     uint32_t Mask = (0 < Pid && Pid < MAXTSPIDS) ? receiverMask[Pid] : 0;
+     for (int i = 0; Mask; i++, Mask >>= 1) {
+         if (Mask & 1)
+            Detach(receiver[i]);
          }
      }
 }
 
+void cDevice::SetReceiverMask(cReceiver *Receiver, int Index, bool On)
+{
+  uint32_t Bit = 1 << Index;
+  for (int n = 0; n < Receiver->numPids; n++) {
+      int Pid = Receiver->pids[n];
+      if (0 < Pid && Pid < MAXTSPIDS) {
+         if (On)
+            receiverMask[Pid] |= Bit;
+         else
+            receiverMask[Pid] &= ~Bit;
+         }
+      }
+}
+
 void cDevice::DetachAllReceivers(void)
 {
   cMutexLock MutexLock(&mutexReceiver);
@@ -1579,9 +1635,10 @@ cTSBuffer::cTSBuffer(int File, int Size, int CardIndex)
   SetDescription("TS buffer on device %d", CardIndex);
   f = File;
   cardIndex = CardIndex;
-  delivered = false;
+  delivered = 0;
   ringBuffer = new cRingBufferLinear(Size, TS_SIZE, true, "TS");
   ringBuffer->SetTimeouts(100, 100);
+  ringBuffer->SetSingleProducerConsumer();
   Start();
 }
 
@@ -1615,26 +1672,37 @@ void cTSBuffer::Action(void)
 
 uchar *cTSBuffer::Get(void)
 {
-  int Count = 0;
+  int Count;
+  return Get(Count, 1);
+}
+
+uchar *cTSBuffer::Get(int &Count, int MaxCount)
+{
   if (delivered) {
-     ringBuffer->Del(TS_SIZE);
-     delivered = false;
+     ringBuffer->Del(delivered);
+     delivered = 0;
      }
+  Count = 0;
   uchar *p = ringBuffer->Get(Count);
   if (p && Count >= TS_SIZE) {
      if (*p != TS_SYNC_BYTE) {
-        for (int i = 1; i < Count; i++) {
-            if (p[i] == TS_SYNC_BYTE) {
-               Count = i;
-               break;
-               }
-            }
+        uchar *q = (uchar *)memchr(p + 1, TS_SYNC_BYTE, Count - 1); // vectorized by the C library
+        if (q)
+           Count = q - p;
         ringBuffer->Del(Count);
         esyslog("ERROR: skipped %d bytes to sync on TS packet on device %d", Count, cardIndex);
+        Count = 0;
         return NULL;
         }
-     delivered = true;
+     // Deliver all consecutive packets that are in sync:
+     int Length = TS_SIZE;
+     int Limit = min(Count, MaxCount * TS_SIZE);
+     while (Length + TS_SIZE <= Limit && p[Length] == TS_SYNC_BYTE)
+           Length += TS_SIZE;
+     delivered = Length;
+     Count = Length / TS_SIZE;
      return p;
      }
+  Count = 0;
   return NULL;
 }
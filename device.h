@@ -26,13 +26,15 @@
 
 #define MAXDEVICES         16 // the maximum number of devices in the system
 #define MAXPIDHANDLES      64 // the maximum number of different PIDs per device
-#define MAXRECEIVERS       16 // the maximum number of receivers per device
+#define MAXRECEIVERS       16 // the maximum number of receivers per device (at most 32, see cDevice::receiverMask)
+#define MAXTSBATCH        256 // the maximum number of TS packets distributed to the receivers in one go
 #define MAXVOLUME         255
 #define VOLUMEDELTA         5 // used to increase/decrease the volume
 
 #define TS_SIZE          188
 #define TS_SYNC_BYTE     0x47
 #define PID_MASK_HI      0x1F
+#define MAXTSPIDS        0x2000 // the number of different PIDs in a Transport Stream
 
 enum eSetChannelResult { scrOk, scrNotAvailable, scrNoTransfer, scrFailed };
 
@@ -91,6 +93,7 @@ class cPlayer;
 class cReceiver;
 class cPesAssembler;
 class cLiveSubtitle;
+class cMetricCounter;
 
 /// The cDevice class is the base from which actual devices can be derived.
 
@@ -575,6 +578,10 @@ public:
 private:
   cMutex mutexReceiver;
   cReceiver *receiver[MAXRECEIVERS];
+  uint32_t receiverMask[MAXTSPIDS]; // bit i is set if receiver[i] wants the PID
+  cMetricCounter *receivedPackets;
+  cMetricCounter *distributedPackets;
+  void SetReceiverMask(cReceiver *Receiver, int Index, bool On);
 public:
   int Priority(void) const;
       ///< Returns the priority of the current receiving session (0..MAXPRIORITY),
@@ -593,6 +600,16 @@ protected:
       ///< new data available, Data will be set to NULL. The function returns
       ///< false in case of a non recoverable error, otherwise it returns true,
       ///< even if Data is NULL.
+  virtual bool GetTSPackets(uchar *&Data, int &Count, int MaxCount);
+      ///< Gets up to MaxCount TS packets from the DVR of this device, which
+      ///< are stored consecutively in memory at Data (each TS_SIZE bytes long),
+      ///< and returns their number in Count. The data remains valid until the
+      ///< next call to GetTSPackets(). If there is currently no new data
+      ///< available, Data will be set to NULL. The return value has the same
+      ///< meaning as for GetTSPacket().
+      ///< The default implementation simply calls GetTSPacket(), so a derived
+      ///< class only needs to implement this function if it can deliver more
+      ///< than one packet at a time.
 public:
   bool Receiving(bool CheckAny = false) const;
        ///< Returns true if we are currently receiving.
@@ -618,13 +635,17 @@ class cTSBuffer : public cThread {
 private:
   int f;
   int cardIndex;
-  bool delivered;
+  int delivered;
   cRingBufferLinear *ringBuffer;
   virtual void Action(void);
 public:
   cTSBuffer(int File, int Size, int CardIndex);
   ~cTSBuffer();
   uchar *Get(void);
+  uchar *Get(int &Count, int MaxCount);
+       ///< Returns a pointer to up to MaxCount TS packets that are stored
+       ///< consecutively in the buffer and puts their number into Count.
+       ///< The packets are removed from the buffer with the next call to Get().
   };
 
 #endif //__DEVICE_H
@@ -1207,3 +1207,12 @@ bool cDvbDevice::GetTSPacket(uchar *&Data)
      }
   return false;
 }
+
+bool cDvbDevice::GetTSPackets(uchar *&Data, int &Count, int MaxCount)
+{
+  if (tsBuffer) {
+     Data = tsBuffer->Get(Count, MaxCount);
+     return true;
+     }
+  return false;
+}
@@ -155,6 +155,7 @@ protected:
   virtual bool OpenDvr(void);
   virtual void CloseDvr(void);
   virtual bool GetTSPacket(uchar *&Data);
+  virtual bool GetTSPackets(uchar *&Data, int &Count, int MaxCount);
   };
 
 #endif //__DVBDEVICE_H
@@ -74,6 +74,7 @@ int cBackTrace::Get(bool Forward)
 
 class cNonBlockingFileReader : public cThread {
 private:
+  cFramePool *framePool;
   cUnbufferedFile *f;
   uchar *buffer;
   int wanted;
@@ -85,7 +86,7 @@ private:
 protected:
   void Action(void);
 public:
-  cNonBlockingFileReader(void);
+  cNonBlockingFileReader(cFramePool *FramePool);
   ~cNonBlockingFileReader();
   void Clear(void);
   int Read(cUnbufferedFile *File, uchar *Buffer, int Length);
@@ -93,9 +94,10 @@ public:
   bool WaitForDataMs(int msToWait);
   };
 
-cNonBlockingFileReader::cNonBlockingFileReader(void)
+cNonBlockingFileReader::cNonBlockingFileReader(cFramePool *FramePool)
 :cThread("non blocking file reader")
 {
+  framePool = FramePool;
   f = NULL;
   buffer = NULL;
   wanted = length = 0;
@@ -107,14 +109,14 @@ cNonBlockingFileReader::~cNonBlockingFileReader()
 {
   newSet.Signal();
   Cancel(3);
-  free(buffer);
+  framePool->Release(buffer);
 }
 
 void cNonBlockingFileReader::Clear(void)
 {
   Lock();
   f = NULL;
-  free(buffer);
+  framePool->Release(buffer);
   buffer = NULL;
   wanted = length = 0;
   hasData = false;
@@ -191,11 +193,14 @@ private:
   enum ePlayDirs { pdForward, pdBackward };
   static int Speeds[];
   cNonBlockingFileReader *nonBlockingFileReader;
+  cFramePool *framePool;
   cRingBufferFrame *ringBuffer;
   cBackTrace *backTrace;
   cFileName *fileName;
   cIndexFile *index;
   cUnbufferedFile *replayFile;
+  cPatPmtParser *patPmtParser;
+  cTsToPes *tsToPes;
   bool eof;
   bool firstPacket;
   ePlayModes playMode;
@@ -207,6 +212,8 @@ private:
   void TrickSpeed(int Increment);
   void Empty(void);
   bool NextFile(uchar FileNumber = 0, int FileOffset = -1);
+  int ConvertTs(const uchar *Data, int Count, bool Flush);
+  int GetPes(uchar *Data, int Max);
   int Resume(void);
   bool Save(void);
 protected:
@@ -237,9 +244,12 @@ cDvbPlayer::cDvbPlayer(const char *FileName)
 :cThread("dvbplayer")
 {
   nonBlockingFileReader = NULL;
+  framePool = NULL;
   ringBuffer = NULL;
   backTrace = NULL;
   index = NULL;
+  patPmtParser = NULL;
+  tsToPes = NULL;
   eof = false;
   firstPacket = true;
   playMode = pmPlay;
@@ -253,7 +263,12 @@ cDvbPlayer::cDvbPlayer(const char *FileName)
   replayFile = fileName->Open();
   if (!replayFile)
      return;
+  framePool = new cFramePool(PLAYERBUFSIZE);
   ringBuffer = new cRingBufferFrame(PLAYERBUFSIZE);
+  if (fileName->IsTs()) {
+     patPmtParser = new cPatPmtParser;
+     tsToPes = new cTsToPes;
+     }
   // Create the index file:
   index = new cIndexFile(FileName, false);
   if (!index)
@@ -272,8 +287,11 @@ cDvbPlayer::~cDvbPlayer()
   delete readFrame; // might not have been stored in the buffer in Action()
   delete index;
   delete fileName;
+  delete tsToPes;
+  delete patPmtParser;
   delete backTrace;
   delete ringBuffer;
+  delete framePool;
 }
 
 void cDvbPlayer::TrickSpeed(int Increment)
@@ -307,6 +325,8 @@ void cDvbPlayer::Empty(void)
   readFrame = NULL;
   playFrame = NULL;
   ringBuffer->Clear();
+  if (tsToPes)
+     tsToPes->Clear();
   backTrace->Clear();
   DeviceClear();
   firstPacket = true;
@@ -322,6 +342,35 @@ bool cDvbPlayer::NextFile(uchar FileNumber, int FileOffset)
   return replayFile != NULL;
 }
 
+int cDvbPlayer::ConvertTs(const uchar *Data, int Count, bool Flush)
+{
+  // TS recordings are converted to PES here, since that's what the devices play.
+  // Every I-frame starts with a PAT and PMT, which tell us the PIDs:
+  if (patPmtParser->Parse(Data, Count))
+     tsToPes->SetPids(patPmtParser->Vpid(), patPmtParser->Apids(), patPmtParser->Dpids(), patPmtParser->Spids());
+  tsToPes->Put(Data, Count); // the result is fetched for every frame, so this always takes all of it
+  if (Flush)
+     tsToPes->Flush();
+  return tsToPes->Available();
+}
+
+int cDvbPlayer::GetPes(uchar *Data, int Max)
+{
+  int Length = 0;
+  while (Length < Max) {
+        int n;
+        uchar *p = tsToPes->Get(n);
+        if (!p)
+           break;
+        if (n > Max - Length)
+           n = Max - Length;
+        memcpy(Data + Length, p, n);
+        tsToPes->Del(n);
+        Length += n;
+        }
+  return Length;
+}
+
 int cDvbPlayer::Resume(void)
 {
   if (index) {
@@ -373,7 +422,7 @@ void cDvbPlayer::Action(void)
   if (readIndex >= 0)
      isyslog("resuming replay at index %d (%s)", readIndex, *IndexToHMSF(readIndex, true));
 
-  nonBlockingFileReader = new cNonBlockingFileReader;
+  nonBlockingFileReader = new cNonBlockingFileReader(framePool);
   int Length = 0;
   bool Sleep = false;
   bool WaitingForData = false;
@@ -452,12 +501,23 @@ void cDvbPlayer::Action(void)
                        esyslog("ERROR: frame larger than buffer (%d > %d)", Length, MAXFRAMESIZE);
                        Length = MAXFRAMESIZE;
                        }
-                    b = MALLOC(uchar, Length);
+                    if (tsToPes)
+                       Length -= Length % TS_SIZE; // only complete TS packets can be converted
+                    b = framePool->Allocate(Length);
                     }
                  int r = nonBlockingFileReader->Read(replayFile, b, Length);
                  if (r > 0) {
                     WaitingForData = false;
-                    readFrame = new cFrame(b, -r, ftUnknown, readIndex); // hands over b to the ringBuffer
+                    if (tsToPes) {
+                       // In trick modes the frames aren't contiguous, so each one has to be pushed out completely:
+                       bool Flush = (playMode == pmFast || (playMode == pmSlow && playDir == pdBackward)) && !(DeviceHasIBPTrickSpeed() && playDir == pdForward);
+                       int l = ConvertTs(b, r, Flush);
+                       framePool->Release(b);
+                       if (l > 0 && (b = framePool->Allocate(l)) != NULL)
+                          readFrame = framePool->NewFrame(b, GetPes(b, l), ftUnknown, readIndex);
+                       }
+                    else
+                       readFrame = framePool->NewFrame(b, r, ftUnknown, readIndex); // hands over b to the ringBuffer
                     b = NULL;
                     }
                  else if (r == 0)
@@ -701,6 +761,11 @@ void cDvbPlayer::Goto(int Index, bool Still)
      if (Index >= 0 && NextFile(FileNumber, FileOffset) && Still) {
         uchar b[MAXFRAMESIZE + 4 + 5 + 4];
         int r = ReadFrame(replayFile, b, Length, sizeof(b));
+        if (r > 0 && tsToPes) {
+           ConvertTs(b, r, true);
+           r = GetPes(b, MAXFRAMESIZE);
+           tsToPes->Clear();
+           }
         if (r > 0) {
            if (playMode == pmPause)
               DevicePlay();
@@ -14,19 +14,28 @@
 #include "eit.h"
 #include "epg.h"
 #include "i18n.h"
+#include "metrics.h"
 #include "libsi/section.h"
 #include "libsi/descriptor.h"
 
 // --- cEIT ------------------------------------------------------------------
 
+static cMetricCounter AddedEvents("epg.events_added");
+static cMetricCounter UpdatedEvents("epg.events_updated");
+
 class cEIT : public SI::EIT {
+private:
+  bool processed;
 public:
   cEIT(cSchedules *Schedules, int Source, u_char Tid, const u_char *Data, bool OnlyRunningStatus = false);
+  bool Processed(void) { return processed; }
+       ///< Returns true if the section has been fully processed.
   };
 
 cEIT::cEIT(cSchedules *Schedules, int Source, u_char Tid, const u_char *Data, bool OnlyRunningStatus)
 :SI::EIT(Data, false)
 {
+  processed = false;
   if (!CheckCRCAndParse())
      return;
 
@@ -94,8 +103,12 @@ cEIT::cEIT(cSchedules *Schedules, int Source, u_char Tid, const u_char *Data, bo
          pEvent->SetStartTime(SiEitEvent.getStartTime());
          pEvent->SetDuration(SiEitEvent.getDuration());
          }
-      if (newEvent)
+      if (newEvent) {
          pSchedule->AddEvent(newEvent);
+         AddedEvents.Add();
+         }
+      else
+         UpdatedEvents.Add();
       if (Tid == 0x4E) { // we trust only the present/following info on the actual TS
          if (SiEitEvent.getRunningStatus() >= SI::RunningStatusNotRunning)
             pSchedule->SetRunningStatus(pEvent, SiEitEvent.getRunningStatus(), channel);
@@ -273,6 +286,278 @@ cEIT::cEIT(cSchedules *Schedules, int Source, u_char Tid, const u_char *Data, bo
         pSchedule->DropOutdated(SegmentStart, SegmentEnd, Tid, getVersionNumber());
      Schedules->SetModified(pSchedule);
      }
+  processed = true;
+}
+
+// --- cEitSectionCache ------------------------------------------------------
+
+// Most EIT sections are repeated unchanged every few seconds. Those that have
+// already been processed with the same version and CRC are dropped before
+// they are parsed or the schedules are locked. They are only processed again
+// after a while, to keep the 'seen' timestamps of their events up to date:
+
+#define EITCACHEPFREFRESH    10 // seconds after which an unchanged present/following section is processed again
+#define EITCACHESCHEDREFRESH 300 // seconds after which an unchanged schedule section is processed again
+#define EITCACHEPURGE        3600 // seconds after which sections that are no longer received are forgotten
+#define EITCACHEHASHSIZE     8192
+
+static cMetricCounter SkippedSections("epg.sections_skipped");
+
+class cEitSection : public cListObject {
+public:
+  unsigned int id;
+  int source;
+  int tid;
+  int sid;
+  int tsid;
+  int onid;
+  int sectionNumber;
+  int version;
+  uint32_t crc;
+  time_t processed;
+  time_t seen;
+  };
+
+class cEitSectionCache {
+private:
+  cMutex mutex;
+  cList<cEitSection> sections;
+  cHash<cEitSection> hash;
+  int generation;
+  time_t lastPurge;
+  cEitSection *Find(int Source, const SI::eit *Eit, unsigned int &Id);
+  void Clear(void);
+  void Purge(time_t Now);
+public:
+  cEitSectionCache(void);
+  bool Unchanged(int Source, const u_char *Data, int Length);
+       ///< Returns true if the section in Data has already been processed
+       ///< recently, with the same version and CRC.
+  void SetProcessed(int Source, const u_char *Data, int Length);
+       ///< Remembers that the section in Data has been processed. Must be
+       ///< called with the schedules locked for writing.
+  };
+
+static cEitSectionCache EitSectionCache;
+
+cEitSectionCache::cEitSectionCache(void)
+:hash(EITCACHEHASHSIZE)
+{
+  generation = cSchedules::Generation();
+  lastPurge = time(NULL);
+}
+
+static uint32_t SectionCrc(const u_char *Data, int Length)
+{
+  const u_char *p = Data + Length - 4;
+  return uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+cEitSection *cEitSectionCache::Find(int Source, const SI::eit *Eit, unsigned int &Id)
+{
+  int Sid = HILO(Eit->service_id);
+  int Tsid = HILO(Eit->transport_stream_id);
+  int Onid = HILO(Eit->original_network_id);
+  Id = ((((unsigned int)Source * 31 + Eit->table_id) * 31 + Onid) * 31 + Tsid) * 31 + (Sid << 8 | Eit->section_number);
+  cList<cHashObject> *list = hash.GetList(Id);
+  if (list) {
+     for (cHashObject *hob = list->First(); hob; hob = list->Next(hob)) {
+         cEitSection *s = (cEitSection *)hob->Object();
+         if (s->id == Id && s->source == Source && s->tid == Eit->table_id && s->sid == Sid && s->tsid == Tsid && s->onid == Onid && s->sectionNumber == Eit->section_number)
+            return s;
+         }
+     }
+  return NULL;
+}
+
+void cEitSectionCache::Clear(void)
+{
+  hash.Clear();
+  sections.Clear();
+  generation = cSchedules::Generation();
+}
+
+void cEitSectionCache::Purge(time_t Now)
+{
+  cEitSection *s = sections.First();
+  while (s) {
+        cEitSection *next = sections.Next(s);
+        if (Now - s->seen > EITCACHEPURGE) {
+           hash.Del(s, s->id);
+           sections.Del(s);
+           }
+        s = next;
+        }
+  lastPurge = Now;
+}
+
+bool cEitSectionCache::Unchanged(int Source, const u_char *Data, int Length)
+{
+  if (Length < EIT_LEN + 4)
+     return false;
+  cMutexLock MutexLock(&mutex);
+  if (generation != cSchedules::Generation()) {
+     Clear();
+     return false;
+     }
+  unsigned int Id;
+  const SI::eit *Eit = (const SI::eit *)Data;
+  cEitSection *s = Find(Source, Eit, Id);
+  if (s && s->version == Eit->version_number && s->crc == SectionCrc(Data, Length)) {
+     time_t Now = time(NULL);
+     s->seen = Now;
+     return Now - s->processed < ((s->tid & 0xF0) == 0x40 ? EITCACHEPFREFRESH : EITCACHESCHEDREFRESH);
+     }
+  return false;
+}
+
+void cEitSectionCache::SetProcessed(int Source, const u_char *Data, int Length)
+{
+  if (Length < EIT_LEN + 4)
+     return;
+  cMutexLock MutexLock(&mutex);
+  // Events may have been deleted while this section was being checked, but
+  // since we hold the write lock now, this section has been processed after that:
+  if (generation != cSchedules::Generation())
+     Clear();
+  time_t Now = time(NULL);
+  if (Now - lastPurge > EITCACHEPURGE)
+     Purge(Now);
+  unsigned int Id;
+  const SI::eit *Eit = (const SI::eit *)Data;
+  cEitSection *s = Find(Source, Eit, Id);
+  if (!s) {
+     s = new cEitSection;
+     s->id = Id;
+     s->source = Source;
+     s->tid = Eit->table_id;
+     s->sid = HILO(Eit->service_id);
+     s->tsid = HILO(Eit->transport_stream_id);
+     s->onid = HILO(Eit->original_network_id);
+     s->sectionNumber = Eit->section_number;
+     sections.Add(s);
+     hash.Add(s, Id);
+     }
+  s->version = Eit->version_number;
+  s->crc = SectionCrc(Data, Length);
+  s->processed = s->seen = Now;
+}
+
+// --- cEitPendingSections ---------------------------------------------------
+
+// Sections that can't be processed right away, because a reader holds the
+// schedules lock, are kept here and processed by whichever filter gets the
+// write lock next, so that no updates are lost. Only the latest copy of each
+// section is kept, and a section that is processed directly drops its pending
+// copy, so that an older version is never applied after a newer one:
+
+#define EITPENDINGMAX   1000 // the maximum number of sections waiting to be processed
+#define EITPENDINGTIME     2 // ms spent on pending sections under one write lock (at least one is processed)
+
+static cMetricCounter DeferredSections("epg.sections_deferred");
+static cMetricCounter DroppedSections("epg.sections_dropped");
+
+class cEitPendingSection : public cListObject {
+public:
+  int source;
+  u_char tid;
+  u_char *data;
+  int length;
+  cEitPendingSection(int Source, u_char Tid, const u_char *Data, int Length);
+  ~cEitPendingSection();
+  bool SameSection(int Source, const u_char *Data) const;
+  };
+
+cEitPendingSection::cEitPendingSection(int Source, u_char Tid, const u_char *Data, int Length)
+{
+  source = Source;
+  tid = Tid;
+  data = MALLOC(u_char, Length);
+  memcpy(data, Data, Length);
+  length = Length;
+}
+
+cEitPendingSection::~cEitPendingSection()
+{
+  free(data);
+}
+
+bool cEitPendingSection::SameSection(int Source, const u_char *Data) const
+{
+  const SI::eit *a = (const SI::eit *)data;
+  const SI::eit *b = (const SI::eit *)Data;
+  return source == Source && a->table_id == b->table_id && a->section_number == b->section_number && HILO(a->service_id) == HILO(b->service_id) && HILO(a->transport_stream_id) == HILO(b->transport_stream_id) && HILO(a->original_network_id) == HILO(b->original_network_id);
+}
+
+class cEitPendingSections {
+private:
+  cMutex mutex;
+  cList<cEitPendingSection> sections;
+  cEitPendingSection *Find(int Source, const u_char *Data);
+public:
+  void Add(int Source, u_char Tid, const u_char *Data, int Length);
+       ///< Keeps a copy of the section in Data, to be processed later.
+  void Process(cSchedules *Schedules, int Source, const u_char *Data);
+       ///< Processes pending sections for up to EITPENDINGTIME ms, and drops the pending
+       ///< copy of the section in Data, which is about to be processed. Must be
+       ///< called with the schedules locked for writing.
+  };
+
+static cEitPendingSections EitPendingSections;
+
+cEitPendingSection *cEitPendingSections::Find(int Source, const u_char *Data)
+{
+  for (cEitPendingSection *s = sections.First(); s; s = sections.Next(s)) {
+      if (s->SameSection(Source, Data))
+         return s;
+      }
+  return NULL;
+}
+
+void cEitPendingSections::Add(int Source, u_char Tid, const u_char *Data, int Length)
+{
+  if (Length < EIT_LEN + 4)
+     return;
+  cMutexLock MutexLock(&mutex);
+  cEitPendingSection *s = Find(Source, Data);
+  if (s)
+     sections.Del(s);
+  else if (sections.Count() >= EITPENDINGMAX) {
+     // the dropped section will be processed when it is repeated:
+     sections.Del(sections.First());
+     DroppedSections.Add();
+     }
+  sections.Add(new cEitPendingSection(Source, Tid, Data, Length));
+  DeferredSections.Add();
+}
+
+void cEitPendingSections::Process(cSchedules *Schedules, int Source, const u_char *Data)
+{
+  {
+    cMutexLock MutexLock(&mutex);
+    if (!sections.Count())
+       return;
+    cEitPendingSection *s = Find(Source, Data);
+    if (s)
+       sections.Del(s);
+  }
+  // Readers are waiting for the write lock to be released, so this must not
+  // take much longer than processing a single section:
+  cTimeMs Timeout(EITPENDINGTIME);
+  do {
+     cEitPendingSection *s;
+     {
+       cMutexLock MutexLock(&mutex);
+       s = sections.First();
+       if (!s)
+          break;
+       sections.Del(s, false);
+     }
+     cEIT EIT(Schedules, s->source, s->tid, s->data);
+     if (EIT.Processed())
+        EitSectionCache.SetProcessed(s->source, s->data, s->length);
+     delete s;
+     } while (!Timeout.TimedOut());
 }
 
 // --- cTDT ------------------------------------------------------------------
@@ -324,11 +609,21 @@ void cEitFilter::Process(u_short Pid, u_char Tid, const u_char *Data, int Length
 {
   switch (Pid) {
     case 0x12: {
+         if (EitSectionCache.Unchanged(Source(), Data, Length)) {
+            SkippedSections.Add();
+            break;
+            }
          cSchedulesLock SchedulesLock(true, 10);
          cSchedules *Schedules = (cSchedules *)cSchedules::Schedules(SchedulesLock);
-         if (Schedules)
+         if (Schedules) {
+            EitPendingSections.Process(Schedules, Source(), Data);
             cEIT EIT(Schedules, Source(), Tid, Data);
+            if (EIT.Processed())
+               EitSectionCache.SetProcessed(Source(), Data, Length);
+            }
          else {
+            // The section will be processed as soon as any filter gets a write lock:
+            EitPendingSections.Add(Source(), Tid, Data, Length);
             // If we don't get a write lock, let's at least get a read lock, so
             // that we can set the running status and 'seen' timestamp (well, actually
             // with a read lock we shouldn't be doing that, but it's only integers that
@@ -13,12 +13,42 @@
 #include "epg.h"
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include "libsi/si.h"
 #include "timers.h"
 
 #define RUNNINGSTATUSTIMEOUT 30 // seconds before the running status is considered unknown
 
+// The strings of events that have been loaded from an EPG snapshot point into
+// the memory the snapshot is mapped to, so they must not be freed or reallocated:
+
+#define MAXEPGSNAPSHOTS 4 // the number of snapshots that can be mapped during a session
+
+struct tEpgSnapshotStrings {
+  const char *data;
+  size_t size;
+  };
+
+static tEpgSnapshotStrings EpgSnapshotStrings[MAXEPGSNAPSHOTS];
+static int NumEpgSnapshots = 0;
+
+static bool IsSnapshotString(const char *s)
+{
+  for (int i = 0; i < NumEpgSnapshots; i++) {
+      if (s >= EpgSnapshotStrings[i].data && s < EpgSnapshotStrings[i].data + EpgSnapshotStrings[i].size)
+         return true;
+      }
+  return false;
+}
+
+static char *OwnString(char *s)
+{
+  return s && IsSnapshotString(s) ? NULL : s;
+}
+
 // --- tComponent ------------------------------------------------------------
 
 cString tComponent::ToString(void)
@@ -118,9 +148,9 @@ cEvent::cEvent(tEventID EventID)
 
 cEvent::~cEvent()
 {
-  free(title);
-  free(shortText);
-  free(description);
+  free(OwnString(title));
+  free(OwnString(shortText));
+  free(OwnString(description));
   delete components;
 }
 
@@ -165,17 +195,17 @@ void cEvent::SetRunningStatus(int RunningStatus, cChannel *Channel)
 
 void cEvent::SetTitle(const char *Title)
 {
-  title = strcpyrealloc(title, Title);
+  title = strcpyrealloc(OwnString(title), Title);
 }
 
 void cEvent::SetShortText(const char *ShortText)
 {
-  shortText = strcpyrealloc(shortText, ShortText);
+  shortText = strcpyrealloc(OwnString(shortText), ShortText);
 }
 
 void cEvent::SetDescription(const char *Description)
 {
-  description = strcpyrealloc(description, Description);
+  description = strcpyrealloc(OwnString(description), Description);
 }
 
 void cEvent::SetComponents(cComponents *Components)
@@ -187,17 +217,23 @@ void cEvent::SetComponents(cComponents *Components)
 void cEvent::SetStartTime(time_t StartTime)
 {
   if (startTime != StartTime) {
-     if (schedule)
+     if (schedule) {
         schedule->UnhashEvent(this);
+        schedule->UnindexEvent(this);
+        }
      startTime = StartTime;
-     if (schedule)
+     if (schedule) {
         schedule->HashEvent(this);
+        schedule->IndexEvent(this);
+        }
      }
 }
 
 void cEvent::SetDuration(int Duration)
 {
   duration = Duration;
+  if (schedule && duration > schedule->maxDuration)
+     schedule->maxDuration = duration;
 }
 
 void cEvent::SetVps(time_t Vps)
@@ -437,6 +473,14 @@ void ReportEpgBugFixStats(bool Reset)
 
 void cEvent::FixEpgBugs(void)
 {
+  // The strings are changed and freed below, so they must be our own:
+  if (title && !OwnString(title))
+     title = strdup(title);
+  if (shortText && !OwnString(shortText))
+     shortText = strdup(shortText);
+  if (description && !OwnString(description))
+     description = strdup(description);
+
   if (isempty(title)) {
      // we don't want any "(null)" titles
      title = strcpyrealloc(title, tr("No title"));
@@ -651,16 +695,56 @@ Final:
 cSchedule::cSchedule(tChannelID ChannelID)
 {
   channelID = ChannelID;
+  maxDuration = 0;
   hasRunning = false;
   modified = 0;
   presentSeen = 0;
 }
 
+int cSchedule::FirstEventIndex(time_t StartTime) const
+{
+  int Lo = 0;
+  int Hi = eventsIndex.Size();
+  while (Lo < Hi) {
+        int Mid = (Lo + Hi) / 2;
+        if (eventsIndex[Mid]->StartTime() < StartTime)
+           Lo = Mid + 1;
+        else
+           Hi = Mid;
+        }
+  return Lo;
+}
+
+void cSchedule::IndexEvent(cEvent *Event)
+{
+  // Events with the same start time are kept in the order they were added:
+  int i = FirstEventIndex(Event->StartTime() + 1);
+  eventsIndex.Insert(Event, i);
+  if (i > 0)
+     events.Add(Event, eventsIndex[i - 1]);
+  else
+     events.Ins(Event);
+}
+
+void cSchedule::UnindexEvent(cEvent *Event)
+{
+  for (int i = FirstEventIndex(Event->StartTime()); i < eventsIndex.Size() && eventsIndex[i]->StartTime() == Event->StartTime(); i++) {
+      if (eventsIndex[i] == Event) {
+         eventsIndex.Remove(i);
+         events.Del(Event, false);
+         return;
+         }
+      }
+  esyslog("ERROR: event %s not found in schedule %s", *Event->ToDescr(), *channelID.ToString());
+}
+
 cEvent *cSchedule::AddEvent(cEvent *Event)
 {
-  events.Add(Event);
   Event->schedule = this;
   HashEvent(Event);
+  IndexEvent(Event);
+  if (Event->Duration() > maxDuration)
+     maxDuration = Event->Duration();
   return Event;
 }
 
@@ -670,7 +754,9 @@ void cSchedule::DelEvent(cEvent *Event)
      if (hasRunning && Event->IsRunning())
         ClrRunningStatus();
      UnhashEvent(Event);
-     events.Del(Event);
+     UnindexEvent(Event);
+     delete Event;
+     cSchedules::generation++;
      }
 }
 
@@ -692,6 +778,11 @@ const cEvent *cSchedule::GetPresentEvent(void) const
 {
   const cEvent *pe = NULL;
   time_t now = time(NULL);
+  if (!hasRunning) {
+     // Without a running status the present event is simply the one that started last:
+     int i = FirstEventIndex(now + 1) - 1;
+     return i >= 0 ? eventsIndex[i] : NULL;
+     }
   for (cEvent *p = events.First(); p; p = events.Next(p)) {
       if (p->StartTime() <= now)
          pe = p;
@@ -709,11 +800,8 @@ const cEvent *cSchedule::GetFollowingEvent(void) const
   if (p)
      p = events.Next(p);
   else {
-     time_t now = time(NULL);
-     for (p = events.First(); p; p = events.Next(p)) {
-         if (p->StartTime() >= now)
-            break;
-         }
+     int i = FirstEventIndex(time(NULL));
+     p = i < eventsIndex.Size() ? eventsIndex[i] : NULL;
      }
   return p;
 }
@@ -730,16 +818,19 @@ const cEvent *cSchedule::GetEvent(tEventID EventID, time_t StartTime) const
 
 const cEvent *cSchedule::GetEventAround(time_t Time) const
 {
-  const cEvent *pe = NULL;
-  time_t delta = INT_MAX;
-  for (cEvent *p = events.First(); p; p = events.Next(p)) {
-      time_t dt = Time - p->StartTime();
-      if (dt >= 0 && dt < delta && p->EndTime() >= Time) {
-         delta = dt;
-         pe = p;
+  // Returns the event that started last before Time and hasn't ended yet. Only
+  // events that started less than maxDuration before Time need to be checked:
+  int First = FirstEventIndex(Time - maxDuration);
+  for (int i = FirstEventIndex(Time + 1) - 1; i >= First; i--) {
+      const cEvent *pe = eventsIndex[i];
+      if (pe->EndTime() >= Time) {
+         // of several events with the same start time, take the first one:
+         while (i > First && eventsIndex[i - 1]->StartTime() == pe->StartTime() && eventsIndex[i - 1]->EndTime() >= Time)
+               pe = eventsIndex[--i];
+         return pe;
          }
       }
-  return pe;
+  return NULL;
 }
 
 void cSchedule::SetRunningStatus(cEvent *Event, int RunningStatus, cChannel *Channel)
@@ -774,13 +865,13 @@ void cSchedule::ClrRunningStatus(cChannel *Channel)
 
 void cSchedule::ResetVersions(void)
 {
+  cSchedules::generation++;
   for (cEvent *p = events.First(); p; p = events.Next(p))
       p->SetVersion(0xFF);
 }
 
 void cSchedule::Sort(void)
 {
-  events.Sort();
   // Make sure there are no RunningStatusUndefined before the currently running event:
   if (hasRunning) {
      for (cEvent *p = events.First(); p; p = events.Next(p)) {
@@ -794,7 +885,9 @@ void cSchedule::Sort(void)
 void cSchedule::DropOutdated(time_t SegmentStart, time_t SegmentEnd, uchar TableID, uchar Version)
 {
   if (SegmentStart > 0 && SegmentEnd > 0) {
-     for (cEvent *p = events.First(); p; p = events.Next(p)) {
+     // Events that start more than maxDuration before the segment can't overlap it:
+     for (int i = FirstEventIndex(SegmentStart - maxDuration); i < eventsIndex.Size(); i++) {
+         cEvent *p = eventsIndex[i];
          if (p->EndTime() > SegmentStart) {
             if (p->StartTime() < SegmentEnd) {
                // The event overlaps with the given time segment.
@@ -803,12 +896,15 @@ void cSchedule::DropOutdated(time_t SegmentStart, time_t SegmentEnd, uchar Table
                   // within the same table id all events must have the same version.
                   // We can't delete the event right here because a timer might have
                   // a pointer to it, so let's set its id and start time to 0 to have it
-                  // "phased out":
+                  // "phased out". It moves to the front of the list, before the
+                  // events that are still to be checked:
                   if (hasRunning && p->IsRunning())
                      ClrRunningStatus();
                   UnhashEvent(p);
+                  UnindexEvent(p);
                   p->eventID = 0;
                   p->startTime = 0;
+                  IndexEvent(p);
                   }
                }
             else
@@ -904,6 +1000,393 @@ bool cSchedule::Read(FILE *f, cSchedules *Schedules)
   return false;
 }
 
+// --- cEpgSnapshot ----------------------------------------------------------
+
+// The EPG data file is a binary snapshot of the schedules. It consists of a
+// header, followed by the schedules, their events, the events' components and
+// a table of all distinct strings. Each schedule refers to a range of events
+// and each event to a range of components, and strings are given by their
+// offsets in the string table (0 = no string). A snapshot is loaded by mapping
+// the file into memory, and the events use its strings right where they are,
+// until they are changed.
+
+#define EPGSNAPSHOTMAGIC     "VDR-EPG\n"
+#define EPGSNAPSHOTVERSION   1
+#define EPGSNAPSHOTBYTEORDER 0x01020304
+#define EPGSNAPSHOTHASHSIZE  262144
+
+struct tEpgSnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t numSchedules;
+  uint32_t numEvents;
+  uint32_t numComponents;
+  uint32_t stringsSize;
+  int64_t created;
+  };
+
+struct tEpgSnapshotSchedule {
+  int32_t source;
+  int32_t nid;
+  int32_t tid;
+  int32_t sid;
+  int32_t rid;
+  uint32_t firstEvent;
+  uint32_t numEvents;
+  uint32_t reserved;
+  };
+
+struct tEpgSnapshotEvent {
+  int64_t startTime;
+  int64_t vps;
+  uint32_t eventID;
+  int32_t duration;
+  uint32_t title;
+  uint32_t shortText;
+  uint32_t description;
+  uint32_t firstComponent;
+  uint16_t numComponents;
+  uint8_t tableID;
+  uint8_t version;
+  uint32_t reserved;
+  };
+
+struct tEpgSnapshotComponent {
+  uint8_t stream;
+  uint8_t type;
+  char language[MAXLANGCODE2];
+  uint16_t reserved;
+  uint32_t description;
+  };
+
+class cEpgSnapshotBuffer {
+private:
+  uchar *data;
+  size_t size;
+  size_t length;
+public:
+  cEpgSnapshotBuffer(void) { data = NULL; size = length = 0; }
+  ~cEpgSnapshotBuffer() { free(data); }
+  bool Append(const void *Data, size_t Length);
+  const uchar *Data(void) const { return data; }
+  size_t Length(void) const { return length; }
+  };
+
+bool cEpgSnapshotBuffer::Append(const void *Data, size_t Length)
+{
+  if (length + Length > size) {
+     size_t NewSize = max(max(size * 2, length + Length), size_t(KILOBYTE(64)));
+     uchar *NewData = (uchar *)realloc(data, NewSize);
+     if (!NewData) {
+        esyslog("ERROR: out of memory for the EPG snapshot");
+        return false;
+        }
+     data = NewData;
+     size = NewSize;
+     }
+  memcpy(data + length, Data, Length);
+  length += Length;
+  return true;
+}
+
+class cEpgSnapshotString : public cListObject {
+public:
+  uint32_t offset;
+  unsigned int hash;
+  cEpgSnapshotString(uint32_t Offset, unsigned int Hash) { offset = Offset; hash = Hash; }
+  };
+
+class cEpgSnapshot {
+private:
+  tEpgSnapshotHeader header;
+  cEpgSnapshotBuffer schedules;
+  cEpgSnapshotBuffer events;
+  cEpgSnapshotBuffer components;
+  cEpgSnapshotBuffer strings;
+  cList<cEpgSnapshotString> stringList;
+  cHash<cEpgSnapshotString> stringHash;
+  bool ok;
+  uint32_t AddString(const char *s);
+public:
+  cEpgSnapshot(void);
+  void AddSchedule(const cSchedule *Schedule);
+       ///< Adds the given Schedule to this snapshot, the same way as
+       ///< cSchedule::Dump() writes it.
+  bool Write(const char *FileName);
+  static bool IsSnapshot(FILE *f);
+       ///< Returns true if f contains an EPG snapshot. The file position is
+       ///< set to the beginning of the file.
+  static bool Load(FILE *f, const char *FileName, cSchedules *Schedules);
+  };
+
+cEpgSnapshot::cEpgSnapshot(void)
+:stringHash(EPGSNAPSHOTHASHSIZE)
+{
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EPGSNAPSHOTMAGIC, sizeof(header.magic));
+  header.version = EPGSNAPSHOTVERSION;
+  header.byteOrder = EPGSNAPSHOTBYTEORDER;
+  header.created = time(NULL);
+  ok = strings.Append("", 1); // offset 0 means "no string"
+}
+
+uint32_t cEpgSnapshot::AddString(const char *s)
+{
+  if (isempty(s))
+     return 0;
+  unsigned int Hash = 0;
+  for (const char *p = s; *p; p++)
+      Hash = Hash * 31 + uchar(*p);
+  cList<cHashObject> *list = stringHash.GetList(Hash);
+  if (list) {
+     for (cHashObject *hob = list->First(); hob; hob = list->Next(hob)) {
+         cEpgSnapshotString *String = (cEpgSnapshotString *)hob->Object();
+         if (String->hash == Hash && strcmp((const char *)strings.Data() + String->offset, s) == 0)
+            return String->offset;
+         }
+     }
+  cEpgSnapshotString *String = new cEpgSnapshotString(strings.Length(), Hash);
+  ok &= strings.Append(s, strlen(s) + 1);
+  stringList.Add(String);
+  stringHash.Add(String, Hash);
+  return String->offset;
+}
+
+void cEpgSnapshot::AddSchedule(const cSchedule *Schedule)
+{
+  cChannel *channel = Channels.GetByChannelID(Schedule->ChannelID(), true);
+  if (!channel)
+     return;
+  tChannelID ChannelID = channel->GetChannelID();
+  tEpgSnapshotSchedule s;
+  memset(&s, 0, sizeof(s));
+  s.source = ChannelID.Source();
+  s.nid = ChannelID.Nid();
+  s.tid = ChannelID.Tid();
+  s.sid = ChannelID.Sid();
+  s.rid = ChannelID.Rid();
+  s.firstEvent = header.numEvents;
+  time_t Now = time(NULL);
+  for (const cEvent *p = Schedule->Events()->First(); p; p = Schedule->Events()->Next(p)) {
+      if (p->EndTime() + Setup.EPGLinger * 60 < Now)
+         continue;
+      tEpgSnapshotEvent e;
+      memset(&e, 0, sizeof(e));
+      e.startTime = p->StartTime();
+      e.vps = p->Vps();
+      e.eventID = p->EventID();
+      e.duration = p->Duration();
+      e.title = AddString(p->Title());
+      e.shortText = AddString(p->ShortText());
+      e.description = AddString(p->Description());
+      e.firstComponent = header.numComponents;
+      e.tableID = p->TableID();
+      e.version = p->Version();
+      if (const cComponents *Components = p->Components()) {
+         for (int i = 0; i < Components->NumComponents(); i++) {
+             tComponent *Component = Components->Component(i);
+             if (!Setup.UseDolbyDigital && Component->stream == 0x02 && Component->type == 0x05)
+                continue;
+             tEpgSnapshotComponent c;
+             memset(&c, 0, sizeof(c));
+             c.stream = Component->stream;
+             c.type = Component->type;
+             strn0cpy(c.language, Component->language, sizeof(c.language));
+             c.description = AddString(Component->description);
+             ok &= components.Append(&c, sizeof(c));
+             header.numComponents++;
+             e.numComponents++;
+             }
+         }
+      ok &= events.Append(&e, sizeof(e));
+      header.numEvents++;
+      s.numEvents++;
+      }
+  ok &= schedules.Append(&s, sizeof(s));
+  header.numSchedules++;
+}
+
+bool cEpgSnapshot::Write(const char *FileName)
+{
+  if (!ok)
+     return false;
+  header.stringsSize = strings.Length();
+  cSafeFile f(FileName);
+  if (f.Open()) {
+     bool Written = fwrite(&header, sizeof(header), 1, f) == 1
+                 && fwrite(schedules.Data(), 1, schedules.Length(), f) == schedules.Length()
+                 && fwrite(events.Data(), 1, events.Length(), f) == events.Length()
+                 && fwrite(components.Data(), 1, components.Length(), f) == components.Length()
+                 && fwrite(strings.Data(), 1, strings.Length(), f) == strings.Length();
+     if (!Written)
+        LOG_ERROR_STR(FileName);
+     if (f.Close() && Written) {
+        dsyslog("wrote EPG data of %d schedules with %d events to %s", header.numSchedules, header.numEvents, FileName);
+        return true;
+        }
+     }
+  else
+     LOG_ERROR_STR(FileName);
+  return false;
+}
+
+bool cEpgSnapshot::IsSnapshot(FILE *f)
+{
+  char Magic[sizeof(header.magic)];
+  bool Result = fread(Magic, sizeof(Magic), 1, f) == 1 && memcmp(Magic, EPGSNAPSHOTMAGIC, sizeof(Magic)) == 0;
+  rewind(f);
+  return Result;
+}
+
+bool cEpgSnapshot::Load(FILE *f, const char *FileName, cSchedules *Schedules)
+{
+  struct stat st;
+  if (fstat(fileno(f), &st) < 0) {
+     LOG_ERROR_STR(FileName);
+     return false;
+     }
+  size_t Size = st.st_size;
+  if (Size < sizeof(tEpgSnapshotHeader)) {
+     esyslog("ERROR: invalid EPG data file %s", FileName);
+     return false;
+     }
+  // The mapping is writable (but private), because events may change their
+  // strings in place:
+  void *Data = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+  if (Data == MAP_FAILED) {
+     LOG_ERROR_STR(FileName);
+     return false;
+     }
+  const tEpgSnapshotHeader *Header = (const tEpgSnapshotHeader *)Data;
+  const tEpgSnapshotSchedule *ss = (const tEpgSnapshotSchedule *)(Header + 1);
+  const tEpgSnapshotEvent *se = (const tEpgSnapshotEvent *)(ss + Header->numSchedules);
+  const tEpgSnapshotComponent *sc = (const tEpgSnapshotComponent *)(se + Header->numEvents);
+  const char *Strings = (const char *)(sc + Header->numComponents);
+  uint64_t Expected = sizeof(tEpgSnapshotHeader) + uint64_t(Header->numSchedules) * sizeof(tEpgSnapshotSchedule) + uint64_t(Header->numEvents) * sizeof(tEpgSnapshotEvent) + uint64_t(Header->numComponents) * sizeof(tEpgSnapshotComponent) + Header->stringsSize;
+  bool Valid = Header->version == EPGSNAPSHOTVERSION && Header->byteOrder == EPGSNAPSHOTBYTEORDER && Expected == Size && Header->stringsSize > 0 && Strings[0] == 0 && Strings[Header->stringsSize - 1] == 0;
+  for (uint32_t i = 0; Valid && i < Header->numSchedules; i++)
+      Valid = uint64_t(ss[i].firstEvent) + ss[i].numEvents <= Header->numEvents;
+  for (uint32_t i = 0; Valid && i < Header->numEvents; i++)
+      Valid = se[i].title < Header->stringsSize && se[i].shortText < Header->stringsSize && se[i].description < Header->stringsSize && uint64_t(se[i].firstComponent) + se[i].numComponents <= Header->numComponents;
+  for (uint32_t i = 0; Valid && i < Header->numComponents; i++)
+      Valid = sc[i].description < Header->stringsSize;
+  if (!Valid) {
+     esyslog("ERROR: invalid EPG data file %s", FileName);
+     munmap(Data, Size);
+     return false;
+     }
+  // Only if the snapshot can be registered the events can use its strings:
+  bool Borrow = NumEpgSnapshots < MAXEPGSNAPSHOTS;
+  if (Borrow) {
+     EpgSnapshotStrings[NumEpgSnapshots].data = Strings;
+     EpgSnapshotStrings[NumEpgSnapshots].size = Header->stringsSize;
+     NumEpgSnapshots++;
+     }
+  for (uint32_t i = 0; i < Header->numSchedules; i++) {
+      cSchedule *Schedule = Schedules->AddSchedule(tChannelID(ss[i].source, ss[i].nid, ss[i].tid, ss[i].sid, ss[i].rid));
+      if (!Schedule)
+         continue;
+      for (uint32_t j = ss[i].firstEvent; j < ss[i].firstEvent + ss[i].numEvents; j++) {
+          const tEpgSnapshotEvent *e = &se[j];
+          cComponents *Components = NULL;
+          for (int k = 0; k < e->numComponents; k++) {
+              const tEpgSnapshotComponent *c = &sc[e->firstComponent + k];
+              char Language[MAXLANGCODE2];
+              strn0cpy(Language, c->language, sizeof(Language));
+              if (!Components)
+                 Components = new cComponents;
+              Components->SetComponent(k, c->stream, c->type, Language, c->description ? Strings + c->description : NULL);
+              }
+          cEvent *Event = (cEvent *)Schedule->GetEvent(e->eventID, e->startTime);
+          if (Event) {
+             // this event is already known, so it gets copies of the strings
+             Event->SetTitle(e->title ? Strings + e->title : NULL);
+             Event->SetShortText(e->shortText ? Strings + e->shortText : NULL);
+             Event->SetDescription(e->description ? Strings + e->description : NULL);
+             }
+          else {
+             Event = new cEvent(e->eventID);
+             Event->seen = 0;
+             Event->startTime = e->startTime;
+             Event->title = e->title ? Borrow ? (char *)Strings + e->title : strdup(Strings + e->title) : NULL;
+             Event->shortText = e->shortText ? Borrow ? (char *)Strings + e->shortText : strdup(Strings + e->shortText) : NULL;
+             Event->description = e->description ? Borrow ? (char *)Strings + e->description : strdup(Strings + e->description) : NULL;
+             Schedule->AddEvent(Event);
+             }
+          Event->SetTableID(e->tableID);
+          Event->SetVersion(e->version);
+          Event->SetDuration(e->duration);
+          Event->SetVps(e->vps);
+          Event->SetComponents(Components);
+          if (!Event->Title())
+             Event->SetTitle(tr("No title"));
+          }
+      Schedule->Sort();
+      Schedules->SetModified(Schedule);
+      }
+  dsyslog("read EPG data of %d schedules with %d events", Header->numSchedules, Header->numEvents);
+  if (!Borrow)
+     munmap(Data, Size);
+  // otherwise the snapshot stays mapped, since the events use its strings
+  return true;
+}
+
+// --- cEpgDataWriter --------------------------------------------------------
+
+class cEpgDataWriter : public cThread {
+private:
+  cEpgSnapshot *snapshot;
+  char *fileName;
+protected:
+  virtual void Action(void);
+public:
+  cEpgDataWriter(void);
+  virtual ~cEpgDataWriter();
+  void Write(cEpgSnapshot *Snapshot, const char *FileName, bool Wait);
+       ///< Writes Snapshot into the file FileName and deletes it. Unless Wait
+       ///< is true, this is done in a separate thread.
+  };
+
+static cEpgDataWriter EpgDataWriter;
+
+cEpgDataWriter::cEpgDataWriter(void)
+:cThread("EPG data writer")
+{
+  snapshot = NULL;
+  fileName = NULL;
+}
+
+cEpgDataWriter::~cEpgDataWriter()
+{
+  Cancel(3);
+  delete snapshot;
+  free(fileName);
+}
+
+void cEpgDataWriter::Action(void)
+{
+  snapshot->Write(fileName);
+  DELETENULL(snapshot);
+}
+
+void cEpgDataWriter::Write(cEpgSnapshot *Snapshot, const char *FileName, bool Wait)
+{
+  while (Active())
+        cCondWait::SleepMs(10);
+  if (Wait) {
+     Snapshot->Write(FileName);
+     delete Snapshot;
+     }
+  else {
+     delete snapshot;
+     snapshot = Snapshot;
+     free(fileName);
+     fileName = strdup(FileName);
+     Start();
+     }
+}
+
 // --- cSchedulesLock --------------------------------------------------------
 
 cSchedulesLock::cSchedulesLock(bool WriteLock, int TimeoutMs)
@@ -924,6 +1407,34 @@ const char *cSchedules::epgDataFileName = NULL;
 time_t cSchedules::lastCleanup = time(NULL);
 time_t cSchedules::lastDump = time(NULL);
 time_t cSchedules::modified = 0;
+int cSchedules::generation = 0;
+
+cSchedules::cSchedules(void)
+{
+}
+
+static unsigned int HashChannelID(tChannelID ChannelID)
+{
+  return ((ChannelID.Source() * 31 + ChannelID.Nid()) * 31 + ChannelID.Tid()) * 31 + ChannelID.Sid();
+}
+
+void cSchedules::Add(cSchedule *Schedule, cSchedule *After)
+{
+  schedulesHash.Add(Schedule, HashChannelID(Schedule->ChannelID().ClrRid()));
+  cList<cSchedule>::Add(Schedule, After);
+}
+
+void cSchedules::Del(cSchedule *Schedule, bool DeleteObject)
+{
+  schedulesHash.Del(Schedule, HashChannelID(Schedule->ChannelID().ClrRid()));
+  cList<cSchedule>::Del(Schedule, DeleteObject);
+}
+
+void cSchedules::Clear(void)
+{
+  schedulesHash.Clear();
+  cList<cSchedule>::Clear();
+}
 
 const cSchedules *cSchedules::Schedules(cSchedulesLock &SchedulesLock)
 {
@@ -962,13 +1473,21 @@ void cSchedules::Cleanup(bool Force)
         ReportEpgBugFixStats(true);
      }
   if (epgDataFileName && now - lastDump > 600) {
-     cSafeFile f(epgDataFileName);
-     if (f.Open()) {
-        Dump(f);
-        f.Close();
-        }
-     else
-        LOG_ERROR;
+     // The snapshot only copies the data while the schedules are locked, and
+     // the file is written without holding the lock (and in the background,
+     // unless this is the final dump):
+     cEpgSnapshot *Snapshot = NULL;
+     {
+       cSchedulesLock SchedulesLock;
+       cSchedules *s = (cSchedules *)Schedules(SchedulesLock);
+       if (s) {
+          Snapshot = new cEpgSnapshot;
+          for (cSchedule *p = s->First(); p; p = s->Next(p))
+              Snapshot->AddSchedule(p);
+          }
+     }
+     if (Snapshot)
+        EpgDataWriter.Write(Snapshot, epgDataFileName, Force);
      lastDump = now;
      }
 }
@@ -997,16 +1516,41 @@ bool cSchedules::ClearAll(void)
   return false;
 }
 
-bool cSchedules::Dump(FILE *f, const char *Prefix, eDumpMode DumpMode, time_t AtTime)
-{
-  cSchedulesLock SchedulesLock;
-  cSchedules *s = (cSchedules *)Schedules(SchedulesLock);
-  if (s) {
-     for (cSchedule *p = s->First(); p; p = s->Next(p))
-         p->Dump(f, Prefix, DumpMode, AtTime);
-     return true;
-     }
-  return false;
+bool cSchedules::Dump(FILE *f, const char *Prefix, eDumpMode DumpMode, time_t AtTime, const cSchedule *Schedule)
+{
+  // Each schedule is formatted into memory while the schedules are locked, and
+  // is written to f after the lock has been released, so that a slow reader
+  // (like an SVDRP client) doesn't keep the EIT data from being updated.
+  // Schedules are never deleted, so p remains valid between the locks:
+  const cSchedule *p = NULL;
+  for (;;) {
+      char *Buffer = NULL;
+      size_t Length = 0;
+      {
+        cSchedulesLock SchedulesLock;
+        cSchedules *s = (cSchedules *)Schedules(SchedulesLock);
+        if (!s)
+           return false;
+        if (Schedule)
+           p = p ? NULL : Schedule;
+        else
+           p = p ? s->Next(p) : s->First();
+        if (!p)
+           break;
+        FILE *m = open_memstream(&Buffer, &Length);
+        if (!m) {
+           LOG_ERROR;
+           return false;
+           }
+        p->Dump(m, Prefix, DumpMode, AtTime);
+        fclose(m);
+      }
+      bool Ok = fwrite(Buffer, 1, Length, f) == Length;
+      free(Buffer);
+      if (!Ok)
+         return false;
+      }
+  return true;
 }
 
 bool cSchedules::Read(FILE *f)
@@ -1026,7 +1570,7 @@ bool cSchedules::Read(FILE *f)
         else
            return false;
         }
-     bool result = cSchedule::Read(f, s);
+     bool result = OwnFile && cEpgSnapshot::IsSnapshot(f) ? cEpgSnapshot::Load(f, epgDataFileName, s) : cSchedule::Read(f, s);
      if (OwnFile)
         fclose(f);
      if (result) {
@@ -1056,10 +1600,14 @@ cSchedule *cSchedules::AddSchedule(tChannelID ChannelID)
 const cSchedule *cSchedules::GetSchedule(tChannelID ChannelID) const
 {
   ChannelID.ClrRid();
-  for (cSchedule *p = First(); p; p = Next(p)) {
-      if (p->ChannelID() == ChannelID)
-         return p;
-      }
+  cList<cHashObject> *list = schedulesHash.GetList(HashChannelID(ChannelID));
+  if (list) {
+     for (cHashObject *hob = list->First(); hob; hob = list->Next(hob)) {
+         cSchedule *p = (cSchedule *)hob->Object();
+         if (p->ChannelID() == ChannelID)
+            return p;
+         }
+     }
   return NULL;
 }
 
@@ -52,6 +52,7 @@ typedef u_int32_t tEventID;
 
 class cEvent : public cListObject {
   friend class cSchedule;
+  friend class cEpgSnapshot;
 private:
   cSchedule *schedule;     // The Schedule this event belongs to
   tEventID eventID;        // Event ID of this event
@@ -114,14 +115,22 @@ public:
 class cSchedules;
 
 class cSchedule : public cListObject  {
+  friend class cEvent;
 private:
   tChannelID channelID;
-  cList<cEvent> events;
+  cList<cEvent> events; // always sorted by start time
+  cVector<cEvent *> eventsIndex; // the same events in the same order, for binary searches by start time
   cHash<cEvent> eventsHashID;
   cHash<cEvent> eventsHashStartTime;
+  int maxDuration; // no event in this schedule has ever been longer than this
   bool hasRunning;
   time_t modified;
   time_t presentSeen;
+  int FirstEventIndex(time_t StartTime) const;
+      ///< Returns the index (in eventsIndex) of the first event that starts at
+      ///< or after StartTime.
+  void IndexEvent(cEvent *Event);
+  void UnindexEvent(cEvent *Event);
 public:
   cSchedule(tChannelID ChannelID);
   tChannelID ChannelID(void) const { return channelID; }
@@ -134,6 +143,8 @@ public:
   void ClrRunningStatus(cChannel *Channel = NULL);
   void ResetVersions(void);
   void Sort(void);
+      ///< The events are always kept sorted by their start times, so this only
+      ///< cleans up the running status of the events before the running one.
   void DropOutdated(time_t SegmentStart, time_t SegmentEnd, uchar TableID, uchar Version);
   void Cleanup(time_t Time);
   void Cleanup(void);
@@ -164,23 +175,40 @@ class cSchedules : public cList<cSchedule> {
   friend class cSchedulesLock;
 private:
   cRwLock rwlock;
+  cHash<cSchedule> schedulesHash; // by channel ID, without the Rid
   static cSchedules schedules;
   static const char *epgDataFileName;
   static time_t lastCleanup;
   static time_t lastDump;
   static time_t modified;
+  static int generation;
 public:
+  cSchedules(void);
+  void Add(cSchedule *Schedule, cSchedule *After = NULL);
+  void Del(cSchedule *Schedule, bool DeleteObject = true);
+  virtual void Clear(void);
+         ///< These keep the index used by GetSchedule() up to date, so schedules
+         ///< must always be added and removed through a cSchedules (not a
+         ///< cListBase) pointer, with the schedules locked for writing.
   static void SetEpgDataFileName(const char *FileName);
   static const cSchedules *Schedules(cSchedulesLock &SchedulesLock);
          ///< Caller must provide a cSchedulesLock which has to survive the entire
          ///< time the returned cSchedules is accessed. Once the cSchedules is no
          ///< longer used, the cSchedulesLock must be destroyed.
   static time_t Modified(void) { return modified; }
+  static int Generation(void) { return generation; }
+         ///< Returns a number that changes whenever events are deleted or
+         ///< their versions are reset, which means that EIT data has to be
+         ///< processed again, even if it hasn't changed.
   static void SetModified(cSchedule *Schedule);
   static void Cleanup(bool Force = false);
   static void ResetVersions(void);
   static bool ClearAll(void);
-  static bool Dump(FILE *f, const char *Prefix = "", eDumpMode DumpMode = dmAll, time_t AtTime = 0);
+  static bool Dump(FILE *f, const char *Prefix = "", eDumpMode DumpMode = dmAll, time_t AtTime = 0, const cSchedule *Schedule = NULL);
+         ///< Writes the EPG data of the given Schedule (or of all schedules, if
+         ///< Schedule is NULL) to f. The schedules are only locked while each of
+         ///< them is being formatted, not while the data is written to f, so the
+         ///< caller must not hold a cSchedulesLock.
   static bool Read(FILE *f = NULL);
   cSchedule *AddSchedule(tChannelID ChannelID);
   const cSchedule *GetSchedule(tChannelID ChannelID) const;
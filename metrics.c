@@ -0,0 +1,246 @@
+/*
+ * metrics.c: Counters and histograms for the hot paths
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#include "metrics.h"
+#include <pthread.h>
+#include "thread.h"
+
+// Each value is only written by its own thread, but read by others, so it is
+// accessed atomically to keep 64 bit values from tearing on 32 bit machines.
+// Relaxed ordering is enough for this, and costs nothing on 64 bit machines:
+
+#if __GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 7
+#define LOAD_VALUE(v)    __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#define ADD_VALUE(v, x)  __atomic_store_n(&(v), __atomic_load_n(&(v), __ATOMIC_RELAXED) + (x), __ATOMIC_RELAXED)
+#else
+#define LOAD_VALUE(v)    __sync_fetch_and_add(&(v), 0)
+#define ADD_VALUE(v, x)  __sync_fetch_and_add(&(v), (x))
+#endif
+
+// --- cMetricValues ---------------------------------------------------------
+
+class cMetricValues : public cListObject {
+public:
+  int64_t value[MAXMETRICVALUES];
+  cMetricValues(void) { memset(value, 0, sizeof(value)); }
+  };
+
+// --- cMetricRegistry -------------------------------------------------------
+
+class cMetricRegistry {
+private:
+  static void RetireValues(void *Values);
+public:
+  cMutex mutex;
+  cVector<cMetric *> metrics;
+  int numValues;
+  pthread_key_t key;
+  cList<cMetricValues> values; // those of the running threads
+  cList<cMetricValues> unused; // those of ended threads, ready for reuse
+  cMetricValues retired; // the sums of all ended threads
+  cMetricRegistry(void);
+  int64_t *ThreadValues(void);
+  int64_t Sum(int Index);
+  };
+
+static cMetricRegistry &Registry(void)
+{
+  // Metrics are mostly static objects, so the registry must be created when
+  // the first one needs it, and it is never deleted, because metrics may still
+  // be used while static objects are being destroyed:
+  static cMetricRegistry *registry = new cMetricRegistry;
+  return *registry;
+}
+
+cMetricRegistry::cMetricRegistry(void)
+{
+  numValues = 0;
+  pthread_key_create(&key, RetireValues);
+}
+
+void cMetricRegistry::RetireValues(void *Values)
+{
+  cMetricRegistry &r = Registry();
+  cMetricValues *v = (cMetricValues *)Values;
+  cMutexLock MutexLock(&r.mutex);
+  for (int i = 0; i < r.numValues; i++)
+      r.retired.value[i] += v->value[i];
+  memset(v->value, 0, sizeof(v->value));
+  r.values.Del(v, false);
+  r.unused.Add(v);
+}
+
+int64_t *cMetricRegistry::ThreadValues(void)
+{
+  cMetricValues *v = (cMetricValues *)pthread_getspecific(key);
+  if (!v) {
+     cMutexLock MutexLock(&mutex);
+     v = unused.First();
+     if (v)
+        unused.Del(v, false);
+     else
+        v = new cMetricValues;
+     values.Add(v);
+     pthread_setspecific(key, v);
+     }
+  return v->value;
+}
+
+int64_t cMetricRegistry::Sum(int Index)
+{
+  // The values of the running threads are read while they may be changing,
+  // which is fine since each of them is only written by its own thread (and
+  // read atomically):
+  int64_t Sum = retired.value[Index];
+  for (cMetricValues *v = values.First(); v; v = values.Next(v))
+      Sum += LOAD_VALUE(v->value[Index]);
+  return Sum;
+}
+
+// --- cMetric ---------------------------------------------------------------
+
+cMetric::cMetric(const char *Name, int NumValues)
+{
+  name = strdup(Name);
+  numValues = NumValues;
+  cMetricRegistry &r = Registry();
+  cMutexLock MutexLock(&r.mutex);
+  if (r.numValues + NumValues <= MAXMETRICVALUES) {
+     index = r.numValues;
+     r.numValues += NumValues;
+     }
+  else {
+     esyslog("ERROR: too many metrics - '%s' will not be counted", name);
+     index = -1;
+     }
+  r.metrics.Append(this);
+}
+
+cMetric::~cMetric()
+{
+  cMetricRegistry &r = Registry();
+  cMutexLock MutexLock(&r.mutex);
+  for (int i = 0; i < r.metrics.Size(); i++) {
+      if (r.metrics[i] == this) {
+         r.metrics.Remove(i);
+         break;
+         }
+      }
+  free(name);
+  // the values of this metric are not reused, because threads may still be adding to them
+}
+
+void cMetric::Add(int Value, int64_t Amount) const
+{
+  if (index >= 0)
+     ADD_VALUE(Registry().ThreadValues()[index + Value], Amount);
+}
+
+void cMetric::Get(int64_t *Values) const
+{
+  cMetricRegistry &r = Registry();
+  cMutexLock MutexLock(&r.mutex);
+  for (int i = 0; i < numValues; i++)
+      Values[i] = index >= 0 ? r.Sum(index + i) : 0;
+}
+
+// --- cMetricCounter --------------------------------------------------------
+
+cMetricCounter::cMetricCounter(const char *Name)
+:cMetric(Name, 1)
+{
+}
+
+int64_t cMetricCounter::Value(void) const
+{
+  int64_t Value;
+  Get(&Value);
+  return Value;
+}
+
+cString cMetricCounter::Format(const int64_t *Values) const
+{
+  return cString::sprintf("%lld", (long long)Values[0]);
+}
+
+// --- cMetricHistogram ------------------------------------------------------
+
+cMetricHistogram::cMetricHistogram(const char *Name, int LinearStep)
+:cMetric(Name, METRICBUCKETS + 1) // the last value is the sum
+{
+  linearStep = LinearStep;
+}
+
+int cMetricHistogram::Bucket(int64_t Value) const
+{
+  if (Value <= 0)
+     return 0;
+  if (linearStep)
+     return int(min((Value + linearStep - 1) / linearStep, int64_t(METRICBUCKETS - 1)));
+  return min(64 - __builtin_clzll(Value), METRICBUCKETS - 1);
+}
+
+int64_t cMetricHistogram::BucketLimit(int Bucket) const
+{
+  if (linearStep)
+     return int64_t(Bucket) * linearStep;
+  return Bucket ? (int64_t(1) << Bucket) - 1 : 0;
+}
+
+void cMetricHistogram::Observe(int64_t Value) const
+{
+  Add(Bucket(Value), 1);
+  Add(METRICBUCKETS, Value);
+}
+
+cString cMetricHistogram::Format(const int64_t *Values) const
+{
+  int64_t Count = 0;
+  for (int i = 0; i < METRICBUCKETS; i++)
+      Count += Values[i];
+  int64_t Sum = Values[METRICBUCKETS];
+  // The percentiles are given as the upper limits of the buckets they fall into:
+  int64_t Percentile[3] = { 0, 0, 0 };
+  const int Percent[3] = { 50, 90, 99 };
+  int64_t n = 0;
+  int p = 0;
+  for (int i = 0; i < METRICBUCKETS && p < 3; i++) {
+      n += Values[i];
+      while (p < 3 && Count && n * 100 >= Count * Percent[p])
+            Percentile[p++] = BucketLimit(i);
+      }
+  return cString::sprintf("count %lld sum %lld avg %lld p50 %lld p90 %lld p99 %lld", (long long)Count, (long long)Sum, (long long)(Count ? Sum / Count : 0), (long long)Percentile[0], (long long)Percentile[1], (long long)Percentile[2]);
+}
+
+// --- cMetrics --------------------------------------------------------------
+
+int cMetrics::List(cStringList &Lines, const char *Prefix)
+{
+  cMetricRegistry &r = Registry();
+  int64_t Values[MAXMETRICVALUES];
+  cMutexLock MutexLock(&r.mutex);
+  for (int i = 0; i < r.metrics.Size(); i++) {
+      cMetric *m = r.metrics[i];
+      if (!Prefix || startswith(m->Name(), Prefix)) {
+         for (int j = 0; j < m->numValues; j++)
+             Values[j] = m->index >= 0 ? r.Sum(m->index + j) : 0;
+         Lines.Append(strdup(cString::sprintf("%s %s", m->Name(), *m->Format(Values))));
+         }
+      }
+  Lines.Sort();
+  return Lines.Size();
+}
+
+void cMetrics::Log(void)
+{
+  cStringList Lines;
+  List(Lines);
+  for (int i = 0; i < Lines.Size(); i++)
+      isyslog("metric %s", Lines[i]);
+}
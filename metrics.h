@@ -0,0 +1,78 @@
+/*
+ * metrics.h: Counters and histograms for the hot paths
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+#include "tools.h"
+
+#define MAXMETRICVALUES  512 // the total number of values of all metrics
+#define METRICBUCKETS     24 // histogram buckets: 0, 1, 2..3, 4..7, ..., >= 2^22 (unless linear)
+
+/// A cMetric is a named set of values, which are counted separately by each
+/// thread that updates them (without any locking) and summed up when they
+/// are read. The values of threads that have ended are kept.
+
+class cMetric {
+  friend class cMetrics;
+private:
+  char *name;
+  int index;
+  int numValues;
+protected:
+  cMetric(const char *Name, int NumValues);
+  void Add(int Value, int64_t Amount) const;
+       ///< Adds Amount to the given Value (0..NumValues - 1) of this metric, as
+       ///< counted by the calling thread.
+  void Get(int64_t *Values) const;
+       ///< Copies the sums of all values of this metric into Values.
+  virtual cString Format(const int64_t *Values) const = 0;
+public:
+  virtual ~cMetric();
+  const char *Name(void) const { return name; }
+  };
+
+class cMetricCounter : public cMetric {
+protected:
+  virtual cString Format(const int64_t *Values) const;
+public:
+  cMetricCounter(const char *Name);
+  void Add(int64_t Amount = 1) const { cMetric::Add(0, Amount); }
+  int64_t Value(void) const;
+  };
+
+class cMetricHistogram : public cMetric {
+private:
+  int linearStep;
+  int Bucket(int64_t Value) const;
+  int64_t BucketLimit(int Bucket) const;
+protected:
+  virtual cString Format(const int64_t *Values) const;
+public:
+  cMetricHistogram(const char *Name, int LinearStep = 0);
+       ///< If LinearStep is given, the buckets are 0, 1..LinearStep,
+       ///< LinearStep + 1..2 * LinearStep and so on, which is better suited for
+       ///< values with a small, fixed range (like percentages). Otherwise each
+       ///< bucket is twice as large as the previous one.
+  void Observe(int64_t Value) const;
+       ///< Counts Value in the bucket it falls into, and adds it to the sum.
+  };
+
+class cMetrics {
+public:
+  static int List(cStringList &Lines, const char *Prefix = NULL);
+       ///< Puts a line with the name and the current values of every metric
+       ///< whose name starts with Prefix into Lines, sorted by name.
+       ///< Returns the number of lines.
+  static void Log(void);
+       ///< Writes all metrics into the log file.
+  };
+
+#endif //__METRICS_H
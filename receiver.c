@@ -57,6 +57,24 @@ bool cReceiver::WantsPid(int Pid)
   return false;
 }
 
+void cReceiver::ReceiveBatch(uchar **Data, int Count)
+{
+  for (int i = 0; i < Count; i++)
+      Receive(Data[i], TS_SIZE);
+}
+
+void cReceiver::ReceiveContiguous(uchar **Data, int Count)
+{
+  for (int i = 0; i < Count; ) {
+      uchar *b = Data[i];
+      int n = 1;
+      while (i + n < Count && Data[i + n] == b + n * TS_SIZE)
+            n++;
+      Receive(b, n * TS_SIZE);
+      i += n;
+      }
+}
+
 void cReceiver::Detach(void)
 {
   if (device)
@@ -37,6 +37,18 @@ protected:
                ///< as soon as possible, without any unnecessary delay. Each TS packet
                ///< will be delivered only ONCE, so the cReceiver must make sure that
                ///< it will be able to buffer the data if necessary.
+  virtual void ReceiveBatch(uchar **Data, int Count);
+               ///< This function is called from the cDevice we are attached to, and
+               ///< delivers Count TS packets (each TS_SIZE bytes long) at once. The same
+               ///< rules as for Receive() apply.
+               ///< The default implementation calls Receive() for each packet, so
+               ///< a derived class only needs to reimplement this function if it can
+               ///< handle several packets more efficiently than one by one.
+  void ReceiveContiguous(uchar **Data, int Count);
+               ///< Calls Receive() once for every run of packets in Data that are stored
+               ///< consecutively in memory, with Length being a multiple of TS_SIZE.
+               ///< A derived class that can handle such larger blocks of data in its
+               ///< Receive() function can call this from its ReceiveBatch().
 public:
   cReceiver(tChannelID ChannelID, int Priority, int Pid, const int *Pids1 = NULL, const int *Pids2 = NULL, const int *Pids3 = NULL);
                ///< Creates a new receiver for the channel with the given ChannelID with
@@ -13,7 +13,15 @@
 #include <unistd.h>
 #include "shutdown.h"
 
-#define RECORDERBUFSIZE  MEGABYTE(Setup.RecorderBufSize)
+// The recorder buffers start at a quarter of RECORDERBUFSIZE and grow up to
+// RECORDERBUFSIZE when the disk can't keep up, all of them together by at most
+// RecorderBufBudget. A buffer can't grow while its consumer is stuck in front
+// of the wrapped around data (see cRingBufferLinear::Resize()), so the initial
+// size has to be large enough to ride out a stalled disk on its own:
+#define RECORDERBUFINITIAL (RECORDERBUFSIZE / 4)
+#define RECORDERBUFSIZE    MEGABYTE(Setup.RecorderBufSize)
+
+static cRingBufferBudget RecorderBufBudget;
 
 // The maximum time we wait before assuming that a recorded video data stream
 // is broken:
@@ -22,39 +30,84 @@
 #define MINFREEDISKSPACE    (512) // MB
 #define DISKCHECKINTERVAL   100 // seconds
 
+// The recording files are written asynchronously (through a write scheduler
+// shared by all recordings), so that short disk latency spikes don't block
+// the file writer:
+#define WRITEBEHINDBUFFERS  8
+#define WRITEBEHINDBUFSIZE  KILOBYTE(512)
+
 // --- cFileWriter -----------------------------------------------------------
 
 class cFileWriter : public cThread {
 private:
   cRemux *remux;
+  cPatPmtGenerator *patPmt;
+  int framePid;
+  bool hasVideo;
+  bool synced;
+  int frames;
+  int skipped;
   cFileName *fileName;
   cIndexFile *index;
   uchar pictureType;
   int fileSize;
+  int64_t written; // the number of bytes written to the previous files of this recording
+  int previousSizeMB; // the size of the files the recording had before (-1 = unknown)
+  char *recordingName;
   cUnbufferedFile *recordFile;
   time_t lastDiskSpaceCheck;
   bool RunningLowOnDiskSpace(void);
+  int SizeMB(void);
   bool NextFile(void);
+  bool WriteTs(const uchar *Data, int Count);
+  bool StartFrame(uchar PictureType);
 protected:
   virtual void Action(void);
 public:
-  cFileWriter(const char *FileName, cRemux *Remux);
+  cFileWriter(const char *FileName, cRemux *Remux, int VPid = 0, const int *APids = NULL, const int *DPids = NULL, const int *SPids = NULL);
+       ///< If Remux is NULL, a TS recording of the given PIDs is written, and
+       ///< the data has to be delivered through PutTs() instead of running the
+       ///< thread.
   virtual ~cFileWriter();
+  int PutTs(const uchar *Data, int Count);
+       ///< Writes the complete TS packets in Data to the recording.
+       ///< \return Returns the number of bytes actually consumed from Data,
+       ///< or -1 in case of an error.
+  int Frames(void) { return frames; }
+       ///< Returns the number of frames written to the index so far.
   };
 
-cFileWriter::cFileWriter(const char *FileName, cRemux *Remux)
+cFileWriter::cFileWriter(const char *FileName, cRemux *Remux, int VPid, const int *APids, const int *DPids, const int *SPids)
 :cThread("file writer")
 {
   fileName = NULL;
   remux = Remux;
+  patPmt = NULL;
+  framePid = 0;
+  hasVideo = false;
+  synced = false;
+  frames = 0;
+  skipped = 0;
+  if (!remux) {
+     patPmt = new cPatPmtGenerator(VPid, APids, DPids, SPids);
+     hasVideo = VPid && VPid != 1 && VPid != 0x1FFF;
+     // In radio recordings every audio PES packet counts as a frame:
+     framePid = hasVideo ? VPid : (APids && *APids) ? *APids : (DPids && *DPids) ? *DPids : 0;
+     }
   index = NULL;
   pictureType = NO_PICTURE;
   fileSize = 0;
+  written = 0;
+  previousSizeMB = 0;
+  recordingName = strdup(FileName);
   lastDiskSpaceCheck = time(NULL);
-  fileName = new cFileName(FileName, true);
+  fileName = new cFileName(FileName, true, false, !remux);
   recordFile = fileName->Open();
   if (!recordFile)
      return;
+  if (fileName->Number() > 1) // a timer continues an existing recording
+     previousSizeMB = DirSizeMB(FileName);
+  recordFile->SetWriteBehind(WRITEBEHINDBUFFERS, WRITEBEHINDBUFSIZE, fileName->Name());
   // Create the index file:
   index = new cIndexFile(FileName, true);
   if (!index)
@@ -67,6 +120,14 @@ cFileWriter::~cFileWriter()
   Cancel(3);
   delete index;
   delete fileName;
+  delete patPmt;
+  Recordings.SetFileSizeMB(recordingName, SizeMB());
+  free(recordingName);
+}
+
+int cFileWriter::SizeMB(void)
+{
+  return previousSizeMB >= 0 ? previousSizeMB + int((written + fileSize) / MEGABYTE(1)) : -1;
 }
 
 bool cFileWriter::RunningLowOnDiskSpace(void)
@@ -87,7 +148,11 @@ bool cFileWriter::NextFile(void)
   if (recordFile && pictureType == I_FRAME) { // every file shall start with an I_FRAME
      if (fileSize > MEGABYTE(Setup.MaxVideoFileSize) || RunningLowOnDiskSpace()) {
         recordFile = fileName->NextFile();
+        if (recordFile)
+           recordFile->SetWriteBehind(WRITEBEHINDBUFFERS, WRITEBEHINDBUFSIZE, fileName->Name());
+        written += fileSize;
         fileSize = 0;
+        Recordings.SetFileSizeMB(recordingName, SizeMB());
         }
      }
   return recordFile != NULL;
@@ -124,6 +189,84 @@ void cFileWriter::Action(void)
         }
 }
 
+bool cFileWriter::WriteTs(const uchar *Data, int Count)
+{
+  if (!synced || Count <= 0)
+     return true; // everything before the first I-frame is dropped
+  if (recordFile->Write(Data, Count) < 0) {
+     LOG_ERROR_STR(fileName->Name());
+     return false;
+     }
+  fileSize += Count;
+  return true;
+}
+
+bool cFileWriter::StartFrame(uchar PictureType)
+{
+  if (PictureType == I_FRAME)
+     synced = true;
+  if (!synced)
+     return true;
+  pictureType = PictureType;
+  if (!NextFile())
+     return false;
+  if (index)
+     index->Write(pictureType, fileName->Number(), fileSize);
+  frames++;
+  skipped = 0;
+  if (pictureType == I_FRAME)
+     return WriteTs(patPmt->Get(), 2 * TS_SIZE);
+  return true;
+}
+
+int cFileWriter::PutTs(const uchar *Data, int Count)
+{
+  if (!recordFile)
+     return -1;
+  int Used = 0;
+  int Written = 0;
+  int Useless = 0;
+  while (Used + TS_SIZE <= Count) {
+        const uchar *p = Data + Used;
+        if (*p != TS_SYNC_BYTE) {
+           if (!WriteTs(Data + Written, Used - Written))
+              return -1;
+           const uchar *q = (const uchar *)memchr(p + 1, TS_SYNC_BYTE, Count - Used - 1);
+           int Skip = q ? q - p : Count - Used;
+           esyslog("ERROR: skipped %d byte to sync on TS packet", Skip);
+           Used += Skip;
+           Useless += Skip;
+           Written = Used;
+           continue;
+           }
+        if (TsPayloadStart(p) && TsPid(p) == framePid) {
+           uchar PictureType = I_FRAME;
+           if (hasVideo && !TsPictureType(p, Count - Used, PictureType))
+              break; // need more data to tell
+           if (PictureType != NO_PICTURE) {
+              if (!WriteTs(Data + Written, Used - Written) || !StartFrame(PictureType))
+                 return -1;
+              Written = Used;
+              }
+           }
+        if (!synced || TsIsScrambled(p))
+           Useless += TS_SIZE;
+        Used += TS_SIZE;
+        }
+  if (!WriteTs(Data + Written, Used - Written))
+     return -1;
+  // Check if we're getting anywhere here:
+  if (skipped >= 0) {
+     skipped += Useless;
+     if (skipped > MAXNONUSEFULDATA) {
+        esyslog("ERROR: no useful data seen within %d byte of video stream", skipped);
+        skipped = -1;
+        ShutdownHandler.RequestEmergencyExit();
+        }
+     }
+  return Used;
+}
+
 // --- cRecorder -------------------------------------------------------------
 
 cRecorder::cRecorder(const char *FileName, tChannelID ChannelID, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids)
@@ -134,12 +277,25 @@ cRecorder::cRecorder(const char *FileName, tChannelID ChannelID, int Priority, i
 
   SpinUpDisk(FileName);
 
-  ringBuffer = new cRingBufferLinear(RECORDERBUFSIZE, TS_SIZE * 2, true, "Recorder");
+  // A timer that continues an existing recording must stick to its format:
+  bool IsTs = cFileName::IsTsRecording(FileName, Setup.UseTsRecording);
+
+  // In TS recordings the margin makes sure TsPictureType() always gets to see enough data:
+  ringBuffer = new cRingBufferLinear(RECORDERBUFINITIAL, IsTs ? TSPICTURESCAN : TS_SIZE * 2, true, "Recorder", RECORDERBUFSIZE);
   dsyslog("RECORDERBUFSIZE: %d\n", RECORDERBUFSIZE);
+  RecorderBufBudget.SetLimit(MEGABYTE(Setup.RecorderBufBudget));
+  ringBuffer->SetBudget(&RecorderBufBudget);
 
   ringBuffer->SetTimeouts(0, 100);
-  remux = new cRemux(VPid, APids, Setup.UseDolbyDigital ? DPids : NULL, SPids, true);
-  writer = new cFileWriter(FileName, remux);
+  ringBuffer->SetSingleProducerConsumer();
+  if (IsTs) {
+     remux = NULL;
+     writer = new cFileWriter(FileName, NULL, VPid, APids, Setup.UseDolbyDigital ? DPids : NULL, SPids);
+     }
+  else {
+     remux = new cRemux(VPid, APids, Setup.UseDolbyDigital ? DPids : NULL, SPids, true, true);
+     writer = new cFileWriter(FileName, remux);
+     }
 }
 
 cRecorder::~cRecorder()
@@ -153,7 +309,8 @@ cRecorder::~cRecorder()
 void cRecorder::Activate(bool On)
 {
   if (On) {
-     writer->Start();
+     if (remux)
+        writer->Start();
      Start();
      }
   else
@@ -171,6 +328,10 @@ void cRecorder::Receive(uchar *Data, int Length)
 
 void cRecorder::Action(void)
 {
+  if (!remux) {
+     ActionTs();
+     return;
+     }
   while (Running()) {
         int r;
         uchar *b = ringBuffer->Get(r);
@@ -183,3 +344,33 @@ void cRecorder::Action(void)
            }
         }
 }
+
+void cRecorder::ActionTs(void)
+{
+  time_t t = time(NULL);
+  int Frames = 0;
+  while (Running()) {
+        int r;
+        uchar *b = ringBuffer->Get(r);
+        if (b) {
+           int Count = writer->PutTs(b, r);
+           if (Count < 0)
+              break;
+           if (Count)
+              ringBuffer->Del(Count);
+           else
+              cCondWait::SleepMs(10); // wait for enough data to determine the picture type
+           }
+        // Data that doesn't result in any frames (scrambled, or no video at all)
+        // is just as broken as no data:
+        if (writer->Frames() != Frames) {
+           Frames = writer->Frames();
+           t = time(NULL);
+           }
+        else if (time(NULL) - t > MAXBROKENTIMEOUT) {
+           esyslog("ERROR: video data stream broken");
+           ShutdownHandler.RequestEmergencyExit();
+           t = time(NULL);
+           }
+        }
+}
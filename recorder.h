@@ -23,9 +23,11 @@ private:
   cRingBufferLinear *ringBuffer;
   cRemux *remux;
   cFileWriter *writer;
+  void ActionTs(void);
 protected:
   virtual void Activate(bool On);
   virtual void Receive(uchar *Data, int Length);
+  virtual void ReceiveBatch(uchar **Data, int Count) { ReceiveContiguous(Data, Count); }
   virtual void Action(void);
 public:
   cRecorder(const char *FileName, tChannelID ChannelID, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids);
@@ -14,7 +14,10 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <unistd.h>
 #include "channels.h"
 #include "i18n.h"
@@ -146,7 +149,7 @@ void AssertFreeDiskSpace(int Priority, bool Force)
            cRecording *r = DeletedRecordings.First();
            cRecording *r0 = NULL;
            while (r) {
-                 if (IsOnVideoDirectoryFileSystem(r->FileName())) { // only remove recordings that will actually increase the free video disk space
+                 if (r->IsOnVideoDirectoryFileSystem()) { // only remove recordings that will actually increase the free video disk space
                     if (!r0 || r->start < r0->start)
                        r0 = r;
                     }
@@ -172,7 +175,7 @@ void AssertFreeDiskSpace(int Priority, bool Force)
            cRecording *r = Recordings.First();
            cRecording *r0 = NULL;
            while (r) {
-                 if (IsOnVideoDirectoryFileSystem(r->FileName())) { // only delete recordings that will actually increase the free video disk space
+                 if (r->IsOnVideoDirectoryFileSystem()) { // only delete recordings that will actually increase the free video disk space
                     if (!r->IsEdited() && r->lifetime < MAXLIFETIME) { // edited recordings and recordings with MAXLIFETIME live forever
                        if ((r->lifetime == 0 && Priority > r->priority) || // the recording has no guaranteed lifetime and the new recording has higher priority
                            (r->lifetime > 0 && (time(NULL) - r->start) / SECSINDAY >= r->lifetime)) { // the recording's guaranteed lifetime has expired
@@ -495,6 +498,8 @@ cRecording::cRecording(cTimer *Timer, const cEvent *Event)
   fileName = NULL;
   name = NULL;
   fileSizeMB = -1; // unknown
+  onVideoDirectoryFileSystem = -1; // unknown
+  fileNameHash = 0;
   deleted = 0;
   // set up the actual name:
   const char *Title = Event ? Event->Title() : NULL;
@@ -543,9 +548,33 @@ cRecording::cRecording(cTimer *Timer, const cEvent *Event)
 }
 
 cRecording::cRecording(const char *FileName)
+{
+  if (Initialize(FileName)) {
+     GetResume();
+     ReadInfo();
+     }
+}
+
+cRecording::cRecording(const char *FileName, const char *InfoText, int Resume)
+{
+  if (Initialize(FileName)) {
+     resume = Resume;
+     if (*InfoText) {
+        FILE *f = fmemopen((void *)InfoText, strlen(InfoText), "r");
+        if (f) {
+           info->Read(f);
+           fclose(f);
+           }
+        }
+     }
+}
+
+bool cRecording::Initialize(const char *FileName)
 {
   resume = RESUME_NOT_INITIALIZED;
   fileSizeMB = -1; // unknown
+  onVideoDirectoryFileSystem = -1; // unknown
+  fileNameHash = 0;
   deleted = 0;
   titleBuffer = NULL;
   sortBuffer = NULL;
@@ -570,70 +599,74 @@ cRecording::cRecording(const char *FileName)
         name[p - FileName] = 0;
         name = ExchangeChars(name, false);
         }
-     GetResume();
-     // read an optional info file:
-     cString InfoFileName = cString::sprintf("%s%s", fileName, INFOFILESUFFIX);
-     FILE *f = fopen(InfoFileName, "r");
-     if (f) {
-        if (!info->Read(f))
-           esyslog("ERROR: EPG data problem in file %s", *InfoFileName);
-        fclose(f);
-        }
-     else if (errno != ENOENT)
-        LOG_ERROR_STR(*InfoFileName);
+     }
+  return p != NULL;
+}
+
+void cRecording::ReadInfo(void)
+{
+  // read an optional info file:
+  cString InfoFileName = cString::sprintf("%s%s", fileName, INFOFILESUFFIX);
+  FILE *f = fopen(InfoFileName, "r");
+  if (f) {
+     if (!info->Read(f))
+        esyslog("ERROR: EPG data problem in file %s", *InfoFileName);
+     fclose(f);
+     }
+  else if (errno != ENOENT)
+     LOG_ERROR_STR(*InfoFileName);
 #ifdef SUMMARYFALLBACK
-     // fall back to the old 'summary.vdr' if there was no 'info.vdr':
-     if (isempty(info->Title())) {
-        cString SummaryFileName = cString::sprintf("%s%s", fileName, SUMMARYFILESUFFIX);
-        FILE *f = fopen(SummaryFileName, "r");
-        if (f) {
-           int line = 0;
-           char *data[3] = { NULL };
-           cReadLine ReadLine;
-           char *s;
-           while ((s = ReadLine.Read(f)) != NULL) {
-                 if (*s || line > 1) {
-                    if (data[line]) {
-                       int len = strlen(s);
-                       len += strlen(data[line]) + 1;
-                       data[line] = (char *)realloc(data[line], len + 1);
-                       strcat(data[line], "\n");
-                       strcat(data[line], s);
-                       }
-                    else
-                       data[line] = strdup(s);
+  // fall back to the old 'summary.vdr' if there was no 'info.vdr':
+  if (isempty(info->Title())) {
+     cString SummaryFileName = cString::sprintf("%s%s", fileName, SUMMARYFILESUFFIX);
+     FILE *f = fopen(SummaryFileName, "r");
+     if (f) {
+        int line = 0;
+        char *data[3] = { NULL };
+        cReadLine ReadLine;
+        char *s;
+        while ((s = ReadLine.Read(f)) != NULL) {
+              if (*s || line > 1) {
+                 if (data[line]) {
+                    int len = strlen(s);
+                    len += strlen(data[line]) + 1;
+                    data[line] = (char *)realloc(data[line], len + 1);
+                    strcat(data[line], "\n");
+                    strcat(data[line], s);
                     }
                  else
-                    line++;
+                    data[line] = strdup(s);
                  }
-           fclose(f);
-           if (!data[2]) {
+              else
+                 line++;
+              }
+        fclose(f);
+        if (!data[2]) {
+           data[2] = data[1];
+           data[1] = NULL;
+           }
+        else if (data[1] && data[2]) {
+           // if line 1 is too long, it can't be the short text,
+           // so assume the short text is missing and concatenate
+           // line 1 and line 2 to be the long text:
+           int len = strlen(data[1]);
+           if (len > 80) {
+              data[1] = (char *)realloc(data[1], len + 1 + strlen(data[2]) + 1);
+              strcat(data[1], "\n");
+              strcat(data[1], data[2]);
+              free(data[2]);
               data[2] = data[1];
               data[1] = NULL;
               }
-           else if (data[1] && data[2]) {
-              // if line 1 is too long, it can't be the short text,
-              // so assume the short text is missing and concatenate
-              // line 1 and line 2 to be the long text:
-              int len = strlen(data[1]);
-              if (len > 80) {
-                 data[1] = (char *)realloc(data[1], len + 1 + strlen(data[2]) + 1);
-                 strcat(data[1], "\n");
-                 strcat(data[1], data[2]);
-                 free(data[2]);
-                 data[2] = data[1];
-                 data[1] = NULL;
-                 }
-              }
-           info->SetData(data[0], data[1], data[2]);
-           for (int i = 0; i < 3; i ++)
-               free(data[i]);
            }
-        else if (errno != ENOENT)
-           LOG_ERROR_STR(*SummaryFileName);
+        info->SetData(data[0], data[1], data[2]);
+        for (int i = 0; i < 3; i ++)
+            free(data[i]);
         }
-#endif
+     else if (errno != ENOENT)
+        LOG_ERROR_STR(*SummaryFileName);
      }
+#endif
 }
 
 cRecording::~cRecording()
@@ -785,6 +818,13 @@ bool cRecording::IsEdited(void) const
   return *s == '%';
 }
 
+bool cRecording::IsOnVideoDirectoryFileSystem(void) const
+{
+  if (onVideoDirectoryFileSystem < 0)
+     onVideoDirectoryFileSystem = ::IsOnVideoDirectoryFileSystem(FileName());
+  return onVideoDirectoryFileSystem;
+}
+
 bool cRecording::WriteInfo(void)
 {
   cString InfoFileName = cString::sprintf("%s%s", fileName, INFOFILESUFFIX);
@@ -864,16 +904,559 @@ void cRecording::ResetResume(void) const
   resume = RESUME_NOT_INITIALIZED;
 }
 
+// --- cRecordingsChange -----------------------------------------------------
+
+// Changes found by the video directory watcher, or by validating the cache
+// after a rescan, are not applied to the lists of recordings right away. Since
+// that may delete cRecording objects somebody still holds a pointer to, they
+// are queued and applied by the main thread while no menu is open.
+
+class cRecordingsChange : public cListObject {
+public:
+  char *dirName;         // if set, all recordings at or below this directory are removed
+  cRecording *recording; // otherwise this recording is added
+  bool replace;          // or replaces the one with the same file name
+  cRecordingsChange(const char *DirName) { dirName = strdup(DirName); recording = NULL; replace = false; }
+  cRecordingsChange(cRecording *Recording, bool Replace) { dirName = NULL; recording = Recording; replace = Replace; }
+  virtual ~cRecordingsChange() { free(dirName); delete recording; }
+  };
+
+// --- cRecordingsCache ------------------------------------------------------
+
+// The recordings cache keeps the data of all recordings in a binary file in
+// the video directory, so that at startup the list of recordings can be
+// built without reading each recording's info and resume file. Cached data
+// is used as is while scanning, and is validated afterwards by comparing the
+// change times of these files.
+
+#define RECORDINGSCACHEMAGIC    0x52435256 // "VRCR"
+#define RECORDINGSCACHEVERSION  1
+#define RECORDINGSCACHEHASHSIZE 4096
+
+struct tRecordingsCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+  };
+
+struct tRecordingsCacheEntry {
+  uint32_t length; // of the entire entry, including the strings and padding
+  int32_t resume;
+  int32_t fileSizeMB;
+  int32_t infoSize;
+  int64_t dirTime;
+  int64_t infoTime;
+  int64_t resumeTime;
+  // followed by the 0-terminated file name and info text
+  const char *FileName(void) const { return (const char *)(this + 1); }
+  const char *InfoText(void) const { const char *s = FileName(); return s + strlen(s) + 1; }
+  void GetStamps(const char *RecordingFileName);
+  bool SameStamps(const tRecordingsCacheEntry &Entry) const { return infoTime == Entry.infoTime && infoSize == Entry.infoSize && resumeTime == Entry.resumeTime; }
+  void Outdate(void) { infoSize = -2; } // never matches an actual file
+  };
+
+void tRecordingsCacheEntry::GetStamps(const char *RecordingFileName)
+{
+  struct stat st;
+  dirTime = stat(RecordingFileName, &st) == 0 ? st.st_mtime : 0;
+  infoTime = 0;
+  infoSize = -1;
+  if (stat(cString::sprintf("%s%s", RecordingFileName, INFOFILESUFFIX), &st) == 0
+#ifdef SUMMARYFALLBACK
+      || stat(cString::sprintf("%s%s", RecordingFileName, SUMMARYFILESUFFIX), &st) == 0
+#endif
+     ) {
+     infoTime = st.st_ctime;
+     infoSize = st.st_size;
+     }
+  cResumeFile ResumeFile(RecordingFileName);
+  resumeTime = ResumeFile.FileName() && stat(ResumeFile.FileName(), &st) == 0 ? st.st_ctime : 0;
+}
+
+static unsigned int HashName(const char *s)
+{
+  unsigned int h = 2166136261u; // FNV-1a
+  while (*s)
+        h = (h ^ (uchar)*s++) * 16777619u;
+  return h;
+}
+
+class cCachedRecording : public cListObject {
+public:
+  const tRecordingsCacheEntry *entry;
+  bool used;
+  cCachedRecording(const tRecordingsCacheEntry *Entry) { entry = Entry; used = false; }
+  };
+
+class cRecordingsCache {
+private:
+  char *data;
+  size_t size;
+  cList<cCachedRecording> entries;
+  cHash<cCachedRecording> hash;
+public:
+  cRecordingsCache(void);
+  ~cRecordingsCache();
+  void Load(const char *FileName);
+  cRecording *Get(const char *FileName, time_t DirTime);
+       ///< Returns a new recording made from the cached data of FileName,
+       ///< or NULL if there is no such data.
+  void Validate(cRecordings *Recordings);
+       ///< Rereads all recordings in Recordings that were taken from this cache
+       ///< and have changed on disk since the cache was written.
+  static void Save(const char *FileName, cRecordings *Recordings);
+  };
+
+cRecordingsCache::cRecordingsCache(void)
+:hash(RECORDINGSCACHEHASHSIZE)
+{
+  data = NULL;
+  size = 0;
+}
+
+cRecordingsCache::~cRecordingsCache()
+{
+  hash.Clear();
+  entries.Clear();
+  if (data)
+     munmap(data, size);
+}
+
+void cRecordingsCache::Load(const char *FileName)
+{
+  int f = open(FileName, O_RDONLY);
+  if (f < 0) {
+     if (errno != ENOENT)
+        LOG_ERROR_STR(FileName);
+     return;
+     }
+  struct stat st;
+  if (fstat(f, &st) == 0 && st.st_size >= off_t(sizeof(tRecordingsCacheHeader))) {
+     void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+     if (p != MAP_FAILED) {
+        data = (char *)p;
+        size = st.st_size;
+        }
+     else
+        LOG_ERROR_STR(FileName);
+     }
+  close(f);
+  if (!data)
+     return;
+  const tRecordingsCacheHeader *Header = (const tRecordingsCacheHeader *)data;
+  if (Header->magic != RECORDINGSCACHEMAGIC || Header->version != RECORDINGSCACHEVERSION) {
+     isyslog("ignoring recordings cache %s of unknown format", FileName);
+     return;
+     }
+  const char *p = data + sizeof(tRecordingsCacheHeader);
+  const char *End = data + size;
+  for (uint32_t i = 0; i < Header->count; i++) {
+      const tRecordingsCacheEntry *Entry = (const tRecordingsCacheEntry *)p;
+      if (End - p < int(sizeof(tRecordingsCacheEntry)) || Entry->length < sizeof(tRecordingsCacheEntry) || Entry->length > size_t(End - p) || (Entry->length & 7) != 0 || p[Entry->length - 1] || !memchr(Entry->FileName(), 0, p + Entry->length - Entry->FileName())) {
+         esyslog("ERROR: recordings cache %s is corrupt", FileName);
+         hash.Clear();
+         entries.Clear();
+         return;
+         }
+      cCachedRecording *CachedRecording = new cCachedRecording(Entry);
+      entries.Add(CachedRecording);
+      hash.Add(CachedRecording, HashName(Entry->FileName()));
+      p += Entry->length;
+      }
+}
+
+cRecording *cRecordingsCache::Get(const char *FileName, time_t DirTime)
+{
+  cList<cHashObject> *list = hash.GetList(HashName(FileName));
+  if (list) {
+     for (cHashObject *hob = list->First(); hob; hob = list->Next(hob)) {
+         cCachedRecording *CachedRecording = (cCachedRecording *)hob->Object();
+         const tRecordingsCacheEntry *Entry = CachedRecording->entry;
+         if (!CachedRecording->used && strcmp(Entry->FileName(), FileName) == 0) {
+            CachedRecording->used = true;
+            cRecording *Recording = new cRecording(FileName, Entry->InfoText(), Entry->resume);
+            if (Entry->dirTime == DirTime)
+               Recording->fileSizeMB = Entry->fileSizeMB;
+            return Recording;
+            }
+         }
+     }
+  return NULL;
+}
+
+void cRecordingsCache::Validate(cRecordings *Recordings)
+{
+  cStringList Changed;
+  for (cCachedRecording *CachedRecording = entries.First(); CachedRecording; CachedRecording = entries.Next(CachedRecording)) {
+      if (CachedRecording->used) {
+         const tRecordingsCacheEntry *Entry = CachedRecording->entry;
+         tRecordingsCacheEntry Current;
+         Current.GetStamps(Entry->FileName());
+         if (!Current.SameStamps(*Entry))
+            Changed.Append(strdup(Entry->FileName()));
+         }
+      }
+  if (Changed.Size())
+     dsyslog("rereading %d changed recording(s)", Changed.Size());
+  for (int i = 0; i < Changed.Size(); i++) {
+      cRecording *Recording = new cRecording(Changed[i]);
+      if (Recording->Name())
+         Recordings->AddChange(new cRecordingsChange(Recording, true));
+      else
+         delete Recording;
+      }
+}
+
+void cRecordingsCache::Save(const char *FileName, cRecordings *Recordings)
+{
+  // Collect the data while holding the lock, but don't write to the disk. The
+  // stamps of the files each entry's data came from are taken right before
+  // its data is copied, so that a file that changes in the meantime ends up
+  // with an outdated stamp (and is read again) rather than with outdated data:
+  char *Buffer = NULL;
+  size_t Length = 0;
+  FILE *m = open_memstream(&Buffer, &Length);
+  if (!m) {
+     LOG_ERROR;
+     return;
+     }
+  tRecordingsCacheHeader Header = { RECORDINGSCACHEMAGIC, RECORDINGSCACHEVERSION, 0, 0 };
+  fwrite(&Header, sizeof(Header), 1, m);
+  Recordings->Lock();
+  for (cRecording *Recording = Recordings->First(); Recording; Recording = Recordings->Next(Recording)) {
+      tRecordingsCacheEntry Entry;
+      memset(&Entry, 0, sizeof(Entry));
+      Entry.GetStamps(Recording->FileName());
+      Entry.resume = Recording->resume;
+      Entry.fileSizeMB = Recording->fileSizeMB;
+      long Start = ftell(m);
+      fwrite(&Entry, sizeof(Entry), 1, m);
+      fputs(Recording->FileName(), m);
+      fputc(0, m);
+      Recording->Info()->Write(m);
+      do {
+         fputc(0, m);
+         } while (ftell(m) & 7);
+      Entry.length = ftell(m) - Start;
+      fseek(m, Start, SEEK_SET);
+      fwrite(&Entry, sizeof(Entry), 1, m);
+      fseek(m, 0, SEEK_END);
+      Header.count++;
+      }
+  Recordings->Unlock();
+  rewind(m);
+  fwrite(&Header, sizeof(Header), 1, m);
+  if (fclose(m) == 0) {
+     // Recordings that are about to be replaced with a freshly read copy
+     // still have their old data, so make sure they are read again:
+     cStringList Pending;
+     Recordings->GetPendingReplacements(Pending);
+     if (Pending.Size()) {
+        for (char *p = Buffer + sizeof(Header); p < Buffer + Length; ) {
+            tRecordingsCacheEntry *Entry = (tRecordingsCacheEntry *)p;
+            if (Pending.Find(Entry->FileName()) >= 0)
+               Entry->Outdate();
+            p += Entry->length;
+            }
+        }
+     cSafeFile f(FileName);
+     if (f.Open()) {
+        if (fwrite(Buffer, Length, 1, f) != 1)
+           LOG_ERROR_STR(FileName);
+        f.Close();
+        }
+     }
+  else
+     LOG_ERROR;
+  free(Buffer);
+}
+
+// --- cRecordingsWatcher ----------------------------------------------------
+
+// Instead of rescanning the entire video directory whenever something has
+// changed, the watcher uses inotify to get notified of new, deleted and
+// renamed recordings and hands these changes to Recordings and
+// DeletedRecordings (see cRecordings::ApplyChanges()). Each recording
+// directory is watched as well, so that its info is reread when it is
+// (re)written.
+
+#define WATCHEREVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE)
+
+class cWatchedDirectory : public cListObject {
+public:
+  int wd;
+  char *path;
+  bool recording;
+  cWatchedDirectory(int Wd, const char *Path, bool Recording) { wd = Wd; path = strdup(Path); recording = Recording; }
+  virtual ~cWatchedDirectory() { free(path); }
+  };
+
+static bool IsBelow(const char *FileName, const char *DirName)
+{
+  int l = strlen(DirName);
+  return strncmp(FileName, DirName, l) == 0 && (FileName[l] == 0 || FileName[l] == '/');
+}
+
+class cRecordingsWatcher : public cThread {
+private:
+  int fd;
+  bool failed;
+  bool complete;
+  cMutex rescanMutex;
+  bool rescan;
+  cList<cWatchedDirectory> directories;
+  cHash<cWatchedDirectory> directoryHash;
+  static cRecordings *ListOf(const char *FileName);
+  bool Watch(const char *DirName, bool Recording);
+  void Unwatch(const char *DirName);
+  void WatchTree(const char *DirName, bool AddRecordings);
+  void AddRecording(const char *FileName, bool Replace = false);
+  void HandleEvent(const struct inotify_event *Event);
+  void SetRescan(void);
+protected:
+  virtual void Action(void);
+public:
+  cRecordingsWatcher(void);
+  virtual ~cRecordingsWatcher();
+  void Activate(void);
+       ///< Starts watching the video directory, unless this is not possible
+       ///< (no inotify support, or the video directory is on a network file
+       ///< system, where changes made by other hosts would go unnoticed).
+  bool Watching(void) { return Active() && complete; }
+  bool NeedsRescan(void);
+       ///< Returns true (once) if events have been lost and the lists of
+       ///< recordings need to be rescanned completely.
+  };
+
+cRecordingsWatcher::cRecordingsWatcher(void)
+:cThread("video directory watcher")
+{
+  fd = -1;
+  failed = false;
+  complete = false;
+  rescan = false;
+}
+
+cRecordingsWatcher::~cRecordingsWatcher()
+{
+  Cancel(3);
+  if (fd >= 0)
+     close(fd);
+}
+
+void cRecordingsWatcher::Activate(void)
+{
+  if (fd < 0 && !failed) {
+     struct statfs statFs;
+     if (statfs(VideoDirectory, &statFs) == 0) {
+        switch (statFs.f_type) {
+          case 0x6969:     // NFS
+          case 0x517B:     // SMB
+          case 0xFF534D42: // CIFS
+          case 0x65735546: // FUSE
+               isyslog("%s is on a network file system - not watching it", VideoDirectory);
+               failed = true;
+               return;
+          }
+        }
+     fd = inotify_init();
+     if (fd < 0) {
+        LOG_ERROR;
+        failed = true;
+        return;
+        }
+     complete = true;
+     Start();
+     }
+}
+
+bool cRecordingsWatcher::NeedsRescan(void)
+{
+  cMutexLock MutexLock(&rescanMutex);
+  bool Result = rescan;
+  rescan = false;
+  return Result;
+}
+
+void cRecordingsWatcher::SetRescan(void)
+{
+  cMutexLock MutexLock(&rescanMutex);
+  rescan = true;
+}
+
+cRecordings *cRecordingsWatcher::ListOf(const char *FileName)
+{
+  if (endswith(FileName, RECEXT))
+     return &Recordings;
+  if (endswith(FileName, DELEXT))
+     return &DeletedRecordings;
+  return NULL;
+}
+
+bool cRecordingsWatcher::Watch(const char *DirName, bool Recording)
+{
+  int wd = inotify_add_watch(fd, DirName, WATCHEREVENTS);
+  if (wd < 0) {
+     if (errno == ENOSPC || errno == ENOMEM) {
+        esyslog("ERROR: can't watch %s - increase /proc/sys/fs/inotify/max_user_watches", DirName);
+        complete = false;
+        }
+     else
+        LOG_ERROR_STR(DirName);
+     return false;
+     }
+  cWatchedDirectory *Dir = directoryHash.Get(wd);
+  if (Dir)
+     return strcmp(Dir->path, DirName) == 0; // a different path means we have been here before through a symbolic link
+  Dir = new cWatchedDirectory(wd, DirName, Recording);
+  directories.Add(Dir);
+  directoryHash.Add(Dir, wd);
+  return true;
+}
+
+void cRecordingsWatcher::Unwatch(const char *DirName)
+{
+  for (cWatchedDirectory *Dir = directories.First(); Dir; ) {
+      cWatchedDirectory *next = directories.Next(Dir);
+      if (IsBelow(Dir->path, DirName)) {
+         inotify_rm_watch(fd, Dir->wd); // may fail if the directory is already gone
+         directoryHash.Del(Dir, Dir->wd);
+         directories.Del(Dir);
+         }
+      Dir = next;
+      }
+}
+
+void cRecordingsWatcher::WatchTree(const char *DirName, bool AddRecordings)
+{
+  if (!Watch(DirName, false))
+     return;
+  cReadDir d(DirName);
+  struct dirent *e;
+  while (Running() && complete && (e = d.Next()) != NULL) {
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) {
+           cString FileName = AddDirectory(DirName, e->d_name);
+           struct stat st;
+           if (stat(FileName, &st) == 0 && S_ISDIR(st.st_mode)) {
+              if (ListOf(FileName)) {
+                 Watch(FileName, true);
+                 if (AddRecordings)
+                    AddRecording(FileName);
+                 }
+              else
+                 WatchTree(FileName, AddRecordings);
+              }
+           }
+        }
+}
+
+void cRecordingsWatcher::AddRecording(const char *FileName, bool Replace)
+{
+  cRecordings *List = ListOf(FileName);
+  cRecording *r = new cRecording(FileName);
+  if (r->Name()) {
+     if (List->deleted && !Replace) {
+        r->fileSizeMB = DirSizeMB(FileName);
+        r->deleted = time(NULL);
+        }
+     List->AddChange(new cRecordingsChange(r, Replace));
+     }
+  else
+     delete r;
+}
+
+void cRecordingsWatcher::HandleEvent(const struct inotify_event *Event)
+{
+  if (Event->mask & IN_Q_OVERFLOW) {
+     esyslog("ERROR: lost events while watching %s - rescanning", VideoDirectory);
+     SetRescan();
+     WatchTree(VideoDirectory, false);
+     return;
+     }
+  cWatchedDirectory *Dir = directoryHash.Get(Event->wd);
+  if (!Dir)
+     return;
+  if (Event->mask & IN_IGNORED) { // the directory is gone
+     directoryHash.Del(Dir, Dir->wd);
+     directories.Del(Dir);
+     return;
+     }
+  if (!Event->len || !*Event->name)
+     return;
+  cString FileName = AddDirectory(Dir->path, Event->name);
+  if (Dir->recording) {
+     if ((Event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && (strcmp(Event->name, INFOFILESUFFIX + 1) == 0 || strcmp(Event->name, SUMMARYFILESUFFIX + 1) == 0))
+        AddRecording(Dir->path, true);
+     return;
+     }
+  if (Event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+     if ((Event->mask & IN_ISDIR) || ListOf(FileName)) { // symbolic links to recordings don't have IN_ISDIR
+        Recordings.AddChange(new cRecordingsChange(FileName));
+        DeletedRecordings.AddChange(new cRecordingsChange(FileName));
+        Unwatch(FileName);
+        }
+     }
+  else if (Event->mask & (IN_CREATE | IN_MOVED_TO)) {
+     struct stat st;
+     if (stat(FileName, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (ListOf(FileName)) {
+           Watch(FileName, true);
+           AddRecording(FileName);
+           }
+        else
+           WatchTree(FileName, true);
+        }
+     }
+}
+
+void cRecordingsWatcher::Action(void)
+{
+  WatchTree(VideoDirectory, false);
+  if (complete)
+     dsyslog("watching %d directories in %s", directories.Count(), VideoDirectory);
+  cPoller Poller(fd);
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (Running() && complete) {
+        if (Poller.Poll(1000)) {
+           int r = safe_read(fd, buffer, sizeof(buffer));
+           if (r < 0) {
+              LOG_ERROR;
+              break;
+              }
+           for (char *p = buffer; Running() && p < buffer + r; ) {
+               struct inotify_event *Event = (struct inotify_event *)p;
+               HandleEvent(Event);
+               p += sizeof(struct inotify_event) + Event->len;
+               }
+           }
+        }
+  if (Running()) {
+     esyslog("ERROR: no longer watching %s", VideoDirectory);
+     close(fd);
+     fd = -1;
+     failed = true;
+     SetRescan();
+     }
+}
+
 // --- cRecordings -----------------------------------------------------------
 
 cRecordings Recordings;
 
+static cRecordingsWatcher RecordingsWatcher;
+
 char *cRecordings::updateFileName = NULL;
 
+#define RECORDINGSHASHSIZE 4096
+
 cRecordings::cRecordings(bool Deleted)
 :cThread("video directory scanner")
+,fileNames(RECORDINGSHASHSIZE)
 {
   deleted = Deleted;
+  scanning = false;
+  cache = NULL;
   lastUpdate = 0;
   state = 0;
 }
@@ -883,6 +1466,25 @@ cRecordings::~cRecordings()
   Cancel(3);
 }
 
+void cRecordings::Add(cRecording *Recording, cRecording *After)
+{
+  Recording->fileNameHash = HashName(Recording->FileName());
+  fileNames.Add(Recording, Recording->fileNameHash);
+  cList<cRecording>::Add(Recording, After);
+}
+
+void cRecordings::Del(cRecording *Recording, bool DeleteObject)
+{
+  fileNames.Del(Recording, Recording->fileNameHash);
+  cList<cRecording>::Del(Recording, DeleteObject);
+}
+
+void cRecordings::Clear(void)
+{
+  fileNames.Clear();
+  cList<cRecording>::Clear();
+}
+
 void cRecordings::Action(void)
 {
   Refresh();
@@ -898,11 +1500,78 @@ const char *cRecordings::UpdateFileName(void)
 void cRecordings::Refresh(bool Foreground)
 {
   lastUpdate = time(NULL); // doing this first to make sure we don't miss anything
+  cString CacheFileName = AddDirectory(VideoDirectory, deleted ? ".deleted.cache" : ".recordings.cache");
+  cRecordingsCache Cache;
+  Cache.Load(CacheFileName);
   Lock();
+  scanning = true;
+  cache = &Cache;
   Clear();
   ChangeState();
   Unlock();
   ScanVideoDir(VideoDirectory, Foreground);
+  Lock();
+  scanning = false;
+  cache = NULL;
+  Unlock();
+  if (Foreground || Running()) {
+     Cache.Validate(this);
+     cRecordingsCache::Save(CacheFileName, this);
+     }
+}
+
+void cRecordings::AddChange(cRecordingsChange *Change)
+{
+  cMutexLock MutexLock(&changesMutex);
+  changes.Add(Change);
+}
+
+void cRecordings::GetPendingReplacements(cStringList &FileNames)
+{
+  cMutexLock MutexLock(&changesMutex);
+  for (cRecordingsChange *Change = changes.First(); Change; Change = changes.Next(Change)) {
+      if (Change->replace)
+         FileNames.Append(strdup(Change->recording->FileName()));
+      }
+}
+
+void cRecordings::ApplyChanges(void)
+{
+  cMutexLock MutexLock(&changesMutex);
+  if (!changes.First())
+     return;
+  LOCK_THREAD;
+  if (scanning)
+     return; // changes that come in while scanning are applied afterwards, so they can't create duplicate entries
+  while (cRecordingsChange *Change = changes.First()) {
+        if (Change->dirName) {
+           for (cRecording *r = First(); r; ) {
+               cRecording *next = Next(r);
+               if (IsBelow(r->FileName(), Change->dirName)) {
+                  Del(r);
+                  ChangeState();
+                  }
+               r = next;
+               }
+           }
+        else {
+           cRecording *r = GetByName(Change->recording->FileName());
+           if (Change->replace && r) {
+              Change->recording->fileSizeMB = r->fileSizeMB;
+              Change->recording->deleted = r->deleted;
+              Add(Change->recording, r);
+              Del(r);
+              Change->recording = NULL;
+              ChangeState();
+              }
+           else if (!Change->replace && !r) {
+              Add(Change->recording);
+              Change->recording = NULL;
+              ChangeState();
+              }
+           }
+        changes.Del(Change);
+        }
 }
 
 void cRecordings::ScanVideoDir(const char *DirName, bool Foreground, int LinkLevel)
@@ -933,14 +1602,17 @@ void cRecordings::ScanVideoDir(const char *DirName, bool Foreground, int LinkLev
                  }
               if (S_ISDIR(st.st_mode)) {
                  if (endswith(buffer, deleted ? DELEXT : RECEXT)) {
-                    cRecording *r = new cRecording(buffer);
+                    cRecording *r = cache ? cache->Get(buffer, st.st_mtime) : NULL;
+                    if (!r)
+                       r = new cRecording(buffer);
                     if (r->Name()) {
                        Lock();
                        Add(r);
                        ChangeState();
                        Unlock();
                        if (deleted) {
-                          r->fileSizeMB = DirSizeMB(buffer);
+                          if (r->fileSizeMB < 0)
+                             r->fileSizeMB = DirSizeMB(buffer);
                           r->deleted = time(NULL);
                           }
                        }
@@ -974,6 +1646,10 @@ void cRecordings::TouchUpdate(void)
 
 bool cRecordings::NeedsUpdate(void)
 {
+  if (RecordingsWatcher.NeedsRescan())
+     return true;
+  if (RecordingsWatcher.Watching())
+     return false; // changes are applied through ApplyChanges()
   time_t lastModified = LastModifiedTime(UpdateFileName());
   if (lastModified > time(NULL))
      return false; // somebody's clock isn't running correctly
@@ -982,6 +1658,7 @@ bool cRecordings::NeedsUpdate(void)
 
 bool cRecordings::Update(bool Wait)
 {
+  RecordingsWatcher.Activate();
   if (Wait) {
      Refresh(true);
      return Count() > 0;
@@ -994,10 +1671,14 @@ bool cRecordings::Update(bool Wait)
 cRecording *cRecordings::GetByName(const char *FileName)
 {
   if (FileName) {
-     for (cRecording *recording = First(); recording; recording = Next(recording)) {
-         if (strcmp(recording->FileName(), FileName) == 0)
-            return recording;
-         }
+     cList<cHashObject> *list = fileNames.GetList(HashName(FileName));
+     if (list) {
+        for (cHashObject *hob = list->First(); hob; hob = list->Next(hob)) {
+            cRecording *recording = (cRecording *)hob->Object();
+            if (strcmp(recording->FileName(), FileName) == 0)
+               return recording;
+            }
+        }
      }
   return NULL;
 }
@@ -1025,7 +1706,8 @@ void cRecordings::DelByName(const char *FileName)
      char *ext = strrchr(recording->FileName(), '.');
      if (ext) {
         strncpy(ext, DELEXT, strlen(ext));
-        recording->fileSizeMB = DirSizeMB(recording->FileName());
+        if (recording->fileSizeMB < 0)
+           recording->fileSizeMB = DirSizeMB(recording->FileName());
         recording->deleted = time(NULL);
         DeletedRecordings.Add(recording);
         }
@@ -1036,12 +1718,20 @@ void cRecordings::DelByName(const char *FileName)
      }
 }
 
+void cRecordings::SetFileSizeMB(const char *FileName, int SizeMB)
+{
+  LOCK_THREAD;
+  cRecording *recording = GetByName(FileName);
+  if (recording)
+     recording->fileSizeMB = SizeMB;
+}
+
 int cRecordings::TotalFileSizeMB(void)
 {
   int size = 0;
   LOCK_THREAD;
   for (cRecording *recording = First(); recording; recording = Next(recording)) {
-      if (recording->fileSizeMB > 0 && IsOnVideoDirectoryFileSystem(recording->FileName()))
+      if (recording->fileSizeMB > 0 && recording->IsOnVideoDirectoryFileSystem())
          size += recording->fileSizeMB;
       }
   return size;
@@ -1183,6 +1873,10 @@ void cRecordingUserCommand::InvokeCommand(const char *State, const char *Recordi
 // The minimum age of an index file for considering it no longer to be written:
 #define MININDEXAGE    3600 // seconds
 
+// An index file is mapped with this much room to grow, so that the mapping
+// doesn't have to be renewed every time CatchUp() finds new entries:
+#define INDEXMAPRESERVE MEGABYTE(1)
+
 cIndexFile::cIndexFile(const char *FileName, bool Record)
 :resumeFile(FileName)
 {
@@ -1191,6 +1885,10 @@ cIndexFile::cIndexFile(const char *FileName, bool Record)
   size = 0;
   last = -1;
   index = NULL;
+  mapped = 0;
+  iFramesScanned = 0;
+  writeBuffer = NULL;
+  writeBufferSize = writeBuffered = 0;
   if (FileName) {
      fileName = MALLOC(char, strlen(FileName) + strlen(INDEXFILESUFFIX) + 1);
      if (fileName) {
@@ -1209,24 +1907,27 @@ cIndexFile::cIndexFile(const char *FileName, bool Record)
               last = (buf.st_size + delta) / sizeof(tIndex) - 1;
               if (!Record && last >= 0) {
                  size = last + 1;
-                 index = MALLOC(tIndex, size);
-                 if (index) {
-                    f = open(fileName, O_RDONLY);
-                    if (f >= 0) {
-                       if ((int)safe_read(f, index, buf.st_size) != buf.st_size) {
-                          esyslog("ERROR: can't read from file '%s'", fileName);
-                          free(index);
-                          index = NULL;
-                          close(f);
-                          f = -1;
+                 f = open(fileName, O_RDONLY);
+                 if (f >= 0) {
+                    // we don't close f here, see CatchUp()!
+                    if (!Map(buf.st_size)) {
+                       // fall back to reading the entire index into memory:
+                       index = MALLOC(tIndex, size);
+                       if (index) {
+                          if ((int)safe_read(f, index, buf.st_size) != buf.st_size) {
+                             esyslog("ERROR: can't read from file '%s'", fileName);
+                             free(index);
+                             index = NULL;
+                             close(f);
+                             f = -1;
+                             }
                           }
-                       // we don't close f here, see CatchUp()!
+                       else
+                          esyslog("ERROR: can't allocate %zd bytes for index '%s'", size * sizeof(tIndex), fileName);
                        }
-                    else
-                       LOG_ERROR_STR(fileName);
                     }
                  else
-                    esyslog("ERROR: can't allocate %zd bytes for index '%s'", size * sizeof(tIndex), fileName);
+                    LOG_ERROR_STR(fileName);
                  }
               }
            else
@@ -1253,10 +1954,35 @@ cIndexFile::cIndexFile(const char *FileName, bool Record)
 
 cIndexFile::~cIndexFile()
 {
+  Flush();
+  free(writeBuffer);
   if (f >= 0)
      close(f);
   free(fileName);
-  free(index);
+  if (mapped)
+     munmap(index, mapped);
+  else
+     free(index);
+}
+
+bool cIndexFile::Map(off_t FileSize)
+{
+  // The pages of the index are only read from disk when they are accessed,
+  // and all players of the same recording share them through the page cache.
+  // Mapping beyond the end of the file is fine, since we never access
+  // entries beyond 'last':
+  long PageSize = sysconf(_SC_PAGESIZE);
+  size_t Size = (FileSize + INDEXMAPRESERVE + PageSize - 1) / PageSize * PageSize;
+  void *p = mmap(NULL, Size, PROT_READ, MAP_SHARED, f, 0);
+  if (p == MAP_FAILED) {
+     LOG_ERROR_STR(fileName);
+     return false;
+     }
+  if (mapped)
+     munmap(index, mapped);
+  index = (tIndex *)p;
+  mapped = Size;
+  return true;
 }
 
 bool cIndexFile::CatchUp(int Index)
@@ -1274,7 +2000,11 @@ bool cIndexFile::CatchUp(int Index)
                break;
                }
             int newLast = buf.st_size / sizeof(tIndex) - 1;
-            if (newLast > last) {
+            if (newLast > last && mapped) {
+               if ((newLast + 1) * sizeof(tIndex) <= mapped || Map(buf.st_size))
+                  last = newLast;
+               }
+            else if (newLast > last) {
                if (size <= newLast) {
                   size *= 2;
                   if (size <= newLast)
@@ -1312,10 +2042,36 @@ bool cIndexFile::CatchUp(int Index)
   return index != NULL;
 }
 
+void cIndexFile::SetWriteBuffer(int Entries)
+{
+  Flush();
+  free(writeBuffer);
+  writeBuffer = Entries > 1 ? MALLOC(tIndex, Entries) : NULL;
+  writeBufferSize = writeBuffer ? Entries : 0;
+}
+
+bool cIndexFile::Flush(void)
+{
+  if (f >= 0 && writeBuffered) {
+     if (safe_write(f, writeBuffer, writeBuffered * sizeof(tIndex)) < 0) {
+        LOG_ERROR_STR(fileName);
+        close(f);
+        f = -1;
+        }
+     writeBuffered = 0;
+     }
+  return f >= 0;
+}
+
 bool cIndexFile::Write(uchar PictureType, uchar FileNumber, int FileOffset)
 {
   if (f >= 0) {
      tIndex i = { FileOffset, PictureType, FileNumber, 0 };
+     if (writeBuffer) {
+        writeBuffer[writeBuffered++] = i;
+        last++;
+        return writeBuffered < writeBufferSize || Flush();
+        }
      if (safe_write(f, &i, sizeof(i)) < 0) {
         LOG_ERROR_STR(fileName);
         close(f);
@@ -1349,39 +2105,58 @@ bool cIndexFile::Get(int Index, uchar *FileNumber, int *FileOffset, uchar *Pictu
   return false;
 }
 
+void cIndexFile::ScanIFrames(void)
+{
+  // Only the entries that have been added since the last call are scanned:
+  for ( ; iFramesScanned <= last; iFramesScanned++) {
+      if (index[iFramesScanned].type == I_FRAME)
+         iFrames.Append(iFramesScanned);
+      }
+}
+
 int cIndexFile::GetNextIFrame(int Index, bool Forward, uchar *FileNumber, int *FileOffset, int *Length, bool StayOffEnd)
 {
   if (CatchUp()) {
-     int d = Forward ? 1 : -1;
-     for (;;) {
-         Index += d;
-         if (Index >= 0 && Index < last - ((Forward && StayOffEnd) ? INDEXSAFETYLIMIT : 0)) {
-            if (index[Index].type == I_FRAME) {
-               if (FileNumber)
-                  *FileNumber = index[Index].number;
-               else
-                  FileNumber = &index[Index].number;
-               if (FileOffset)
-                  *FileOffset = index[Index].offset;
-               else
-                  FileOffset = &index[Index].offset;
-               if (Length) {
-                  // all recordings end with a non-I_FRAME, so the following should be safe:
-                  int fn = index[Index + 1].number;
-                  int fo = index[Index + 1].offset;
-                  if (fn == *FileNumber)
-                     *Length = fo - *FileOffset;
-                  else {
-                     esyslog("ERROR: 'I' frame at end of file #%d", *FileNumber);
-                     *Length = -1;
-                     }
-                  }
-               return Index;
-               }
-            }
-         else
-            break;
-         }
+     ScanIFrames();
+     int Limit = last - ((Forward && StayOffEnd) ? INDEXSAFETYLIMIT : 0);
+     Index += Forward ? 1 : -1;
+     if (Index >= 0 && Index < Limit) {
+        // Binary search for the first I_FRAME at or after Index:
+        int lo = 0;
+        int hi = iFrames.Size();
+        while (lo < hi) {
+              int mid = (lo + hi) / 2;
+              if (iFrames[mid] < Index)
+                 lo = mid + 1;
+              else
+                 hi = mid;
+              }
+        if (!Forward && (lo >= iFrames.Size() || iFrames[lo] > Index))
+           lo--; // the last I_FRAME before Index
+        Index = (0 <= lo && lo < iFrames.Size()) ? iFrames[lo] : -1;
+        if (Index >= 0 && Index < Limit) {
+           if (FileNumber)
+              *FileNumber = index[Index].number;
+           else
+              FileNumber = &index[Index].number;
+           if (FileOffset)
+              *FileOffset = index[Index].offset;
+           else
+              FileOffset = &index[Index].offset;
+           if (Length) {
+              // all recordings end with a non-I_FRAME, so the following should be safe:
+              int fn = index[Index + 1].number;
+              int fo = index[Index + 1].offset;
+              if (fn == *FileNumber)
+                 *Length = fo - *FileOffset;
+              else {
+                 esyslog("ERROR: 'I' frame at end of file #%d", *FileNumber);
+                 *Length = -1;
+                 }
+              }
+           return Index;
+           }
+        }
      }
   return -1;
 }
@@ -1389,13 +2164,18 @@ int cIndexFile::GetNextIFrame(int Index, bool Forward, uchar *FileNumber, int *F
 int cIndexFile::Get(uchar FileNumber, int FileOffset)
 {
   if (CatchUp()) {
-     //TODO implement binary search!
-     int i;
-     for (i = 0; i < last; i++) {
-         if (index[i].number > FileNumber || (index[i].number == FileNumber) && index[i].offset >= FileOffset)
-            break;
-         }
-     return i;
+     // The index is sorted by file number and offset, so we can do a binary
+     // search for the first entry at or after the given position:
+     int lo = 0;
+     int hi = last;
+     while (lo < hi) {
+           int mid = (lo + hi) / 2;
+           if (index[mid].number < FileNumber || index[mid].number == FileNumber && index[mid].offset < FileOffset)
+              lo = mid + 1;
+           else
+              hi = mid;
+           }
+     return lo;
      }
   return -1;
 }
@@ -1409,14 +2189,16 @@ bool cIndexFile::IsStillRecording()
 
 #define MAXFILESPERRECORDING 255
 #define RECORDFILESUFFIX    "/%03d.vdr"
+#define TSFILESUFFIX        "/%03d.ts"
 #define RECORDFILESUFFIXLEN 20 // some additional bytes for safety...
 
-cFileName::cFileName(const char *FileName, bool Record, bool Blocking)
+cFileName::cFileName(const char *FileName, bool Record, bool Blocking, bool IsTs)
 {
   file = NULL;
   fileNumber = 0;
   record = Record;
   blocking = Blocking;
+  isTs = IsTs;
   // Prepare the file name:
   fileName = MALLOC(char, strlen(FileName) + RECORDFILESUFFIXLEN);
   if (!fileName) {
@@ -1425,9 +2207,19 @@ cFileName::cFileName(const char *FileName, bool Record, bool Blocking)
      }
   strcpy(fileName, FileName);
   pFileNumber = fileName + strlen(fileName);
+  isTs = IsTsRecording(FileName, record && IsTs);
   SetOffset(1);
 }
 
+bool cFileName::IsTsRecording(const char *FileName, bool Default)
+{
+  if (access(cString::sprintf("%s" TSFILESUFFIX, FileName, 1), F_OK) == 0)
+     return true;
+  if (access(cString::sprintf("%s" RECORDFILESUFFIX, FileName, 1), F_OK) == 0)
+     return false;
+  return Default;
+}
+
 cFileName::~cFileName()
 {
   Close();
@@ -1473,7 +2265,7 @@ cUnbufferedFile *cFileName::SetOffset(int Number, int Offset)
      Close();
   if (0 < Number && Number <= MAXFILESPERRECORDING) {
      fileNumber = Number;
-     sprintf(pFileNumber, RECORDFILESUFFIX, fileNumber);
+     sprintf(pFileNumber, isTs ? TSFILESUFFIX : RECORDFILESUFFIX, fileNumber);
      if (record) {
         if (access(fileName, F_OK) == 0) {
            // files exists, check if it has non-zero size
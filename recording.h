@@ -33,6 +33,7 @@ private:
 public:
   cResumeFile(const char *FileName);
   ~cResumeFile();
+  const char *FileName(void) { return fileName; }
   int Read(void);
   bool Save(int Index);
   void Delete(void);
@@ -64,6 +65,8 @@ public:
 
 class cRecording : public cListObject {
   friend class cRecordings;
+  friend class cRecordingsWatcher;
+  friend class cRecordingsCache;
 private:
   mutable int resume;
   mutable char *titleBuffer;
@@ -71,9 +74,16 @@ private:
   mutable char *fileName;
   mutable char *name;
   mutable int fileSizeMB;
+  mutable int onVideoDirectoryFileSystem;
+  unsigned int fileNameHash;
   cRecordingInfo *info;
   cRecording(const cRecording&); // can't copy cRecording
   cRecording &operator=(const cRecording &); // can't assign cRecording
+  cRecording(const char *FileName, const char *InfoText, int Resume);
+       ///< Creates a recording from data kept in the recordings cache, without
+       ///< reading its info and resume files.
+  bool Initialize(const char *FileName);
+  void ReadInfo(void);
   static char *StripEpisodeName(char *s);
   char *SortName(void) const;
   int GetResume(void) const;
@@ -95,6 +105,9 @@ public:
   void ResetResume(void) const;
   bool IsNew(void) const { return GetResume() <= 0; }
   bool IsEdited(void) const;
+  bool IsOnVideoDirectoryFileSystem(void) const;
+       ///< Returns true if this recording is on one of the file systems of the
+       ///< video directory. The result is determined only once.
   bool WriteInfo(void);
   bool Delete(void);
        // Changes the file name so that it will no longer be visible in the "Recordings" menu
@@ -108,20 +121,38 @@ public:
        // Returns false in case of error
   };
 
+class cRecordingsCache;
+class cRecordingsChange;
+
 class cRecordings : public cList<cRecording>, public cThread {
+  friend class cRecordingsWatcher;
+  friend class cRecordingsCache;
 private:
   static char *updateFileName;
   bool deleted;
+  bool scanning;
+  cRecordingsCache *cache;
+  cHash<cRecording> fileNames;
+  cMutex changesMutex;
+  cList<cRecordingsChange> changes;
   time_t lastUpdate;
   int state;
   const char *UpdateFileName(void);
   void Refresh(bool Foreground = false);
   void ScanVideoDir(const char *DirName, bool Foreground = false, int LinkLevel = 0);
+  void AddChange(cRecordingsChange *Change);
+  void GetPendingReplacements(cStringList &FileNames);
 protected:
   void Action(void);
 public:
   cRecordings(bool Deleted = false);
   virtual ~cRecordings();
+  void Add(cRecording *Recording, cRecording *After = NULL);
+  void Del(cRecording *Recording, bool DeleteObject = true);
+  virtual void Clear(void);
+       ///< These keep the index used by GetByName() up to date, so recordings
+       ///< must always be added and removed through a cRecordings (not a
+       ///< cListBase) pointer.
   bool Load(void) { return Update(true); }
        ///< Loads the current list of recordings and returns true if there
        ///< is anything in it (for compatibility with older plugins - use
@@ -137,12 +168,25 @@ public:
        ///< instances of VDR that access the same video directory can be triggered
        ///< to update their recordings list.
   bool NeedsUpdate(void);
+       ///< Returns true if the list of recordings needs to be rescanned completely.
+       ///< As long as the video directory is watched through inotify, changes
+       ///< are applied to the lists through ApplyChanges(), so this is only necessary
+       ///< if the watcher missed events. Otherwise this checks whether the
+       ///< '.update' file has been touched.
+  void ApplyChanges(void);
+       ///< Applies the changes the video directory watcher has found since the
+       ///< last call. Since this may delete cRecording objects, it must only be
+       ///< called from the main thread while no menu is open.
   void ChangeState(void) { state++; }
   bool StateChanged(int &State);
   void ResetResume(const char *ResumeFileName = NULL);
   cRecording *GetByName(const char *FileName);
   void AddByName(const char *FileName, bool TriggerUpdate = true);
   void DelByName(const char *FileName);
+  void SetFileSizeMB(const char *FileName, int SizeMB);
+       ///< Sets the size of the recording with the given FileName, as counted by
+       ///< whoever wrote it, so that it doesn't have to be determined later by
+       ///< scanning its directory. A SizeMB of -1 means the size is unknown.
   int TotalFileSizeMB(void); ///< Only for deleted recordings!
   };
 
@@ -204,14 +248,27 @@ private:
   char *fileName;
   int size, last;
   tIndex *index;
+  size_t mapped;
+  cVector<int> iFrames; // the positions of all I_FRAMEs in index, in ascending order
+  int iFramesScanned;   // the number of index entries that have been scanned for I_FRAMEs
+  tIndex *writeBuffer;
+  int writeBufferSize, writeBuffered;
   cResumeFile resumeFile;
   cMutex mutex;
+  bool Map(off_t FileSize);
   bool CatchUp(int Index = -1);
+  void ScanIFrames(void);
 public:
   cIndexFile(const char *FileName, bool Record);
   ~cIndexFile();
   bool Ok(void) { return index != NULL; }
   bool Write(uchar PictureType, uchar FileNumber, int FileOffset);
+  void SetWriteBuffer(int Entries);
+       ///< Makes Write() collect up to Entries index entries in memory before
+       ///< writing them to disk in one go. This is only useful if nobody reads
+       ///< the index while it is being written (like when cutting a recording).
+  bool Flush(void);
+       ///< Writes any index entries that have been collected by Write().
   bool Get(int Index, uchar *FileNumber, int *FileOffset, uchar *PictureType = NULL, int *Length = NULL);
   int GetNextIFrame(int Index, bool Forward, uchar *FileNumber = NULL, int *FileOffset = NULL, int *Length = NULL, bool StayOffEnd = false);
   int Get(uchar FileNumber, int FileOffset);
@@ -228,11 +285,20 @@ private:
   char *fileName, *pFileNumber;
   bool record;
   bool blocking;
+  bool isTs;
 public:
-  cFileName(const char *FileName, bool Record, bool Blocking = false);
+  cFileName(const char *FileName, bool Record, bool Blocking = false, bool IsTs = false);
+       ///< If Record is true, IsTs tells whether the files of a TS recording
+       ///< shall be written, unless the recording already has files (like when a
+       ///< timer continues it), in which case their format is kept. Otherwise the
+       ///< format of the existing files is determined automatically.
   ~cFileName();
+  static bool IsTsRecording(const char *FileName, bool Default = false);
+       ///< Returns true if the recording in FileName consists of TS files, false
+       ///< if it consists of PES files, and Default if it has no files yet.
   const char *Name(void) { return fileName; }
   int Number(void) { return fileNumber; }
+  bool IsTs(void) { return isTs; }
   cUnbufferedFile *Open(void);
   void Close(void);
   cUnbufferedFile *SetOffset(int Number, int Offset = 0);
@@ -16,7 +16,16 @@
 
 #include "remux.h"
 #include <stdlib.h>
+#include <unistd.h>
+#if defined(__i386__) || defined(__x86_64__)
+#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define SIMD_STARTCODE_SCANNER
+#include <immintrin.h>
+#endif
+#endif
 #include "channels.h"
+#include "libsi/util.h"
+#include "metrics.h"
 #include "shutdown.h"
 #include "tools.h"
 
@@ -86,6 +95,81 @@ ePesHeader AnalyzePesHeader(const uchar *Data, int Count, int &PesPayloadOffset,
   return phMPEG1; // MPEG 1
 }
 
+// --- Start code scanning ---------------------------------------------------
+
+// All of the following functions return a pointer to the 0x01 byte of the
+// first 0x000001 start code prefix that has this byte in the range
+// [Data, Limit), or NULL if there is no such start code. The two bytes
+// before Data must be accessible.
+
+static const uchar *FindStartCodeScalar(const uchar *Data, const uchar *Limit)
+{
+  while (Data < Limit && (Data = (const uchar *)memchr(Data, 0x01, Limit - Data))) {
+        if (!Data[-2] && !Data[-1])
+           return Data;
+        Data += 3; // continue scanning after 0x01xxyy
+        }
+  return NULL;
+}
+
+#ifdef SIMD_STARTCODE_SCANNER
+
+// The vector versions compare 16 (or 32) positions at once against the
+// complete 0x000001 pattern, so random 0x01 bytes in the video data (which
+// make up most of the hits of the scalar version) cost nothing.
+
+__attribute__((target("sse2")))
+static const uchar *FindStartCodeSSE2(const uchar *Data, const uchar *Limit)
+{
+  const __m128i Zero = _mm_setzero_si128();
+  const __m128i One = _mm_set1_epi8(0x01);
+  while (Limit - Data >= 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data - 2)), Zero);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data - 1)), Zero);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)Data), One);
+        int Mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+        if (Mask)
+           return Data + __builtin_ctz(Mask);
+        Data += 16;
+        }
+  return FindStartCodeScalar(Data, Limit);
+}
+
+__attribute__((target("avx2")))
+static const uchar *FindStartCodeAVX2(const uchar *Data, const uchar *Limit)
+{
+  const __m256i Zero = _mm256_setzero_si256();
+  const __m256i One = _mm256_set1_epi8(0x01);
+  while (Limit - Data >= 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Data - 2)), Zero);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Data - 1)), Zero);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)Data), One);
+        unsigned int Mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+        if (Mask)
+           return Data + __builtin_ctz(Mask);
+        Data += 32;
+        }
+  return FindStartCodeSSE2(Data, Limit);
+}
+
+#endif
+
+typedef const uchar *(*tStartCodeScanner)(const uchar *Data, const uchar *Limit);
+
+static tStartCodeScanner SelectStartCodeScanner(void)
+{
+#ifdef SIMD_STARTCODE_SCANNER
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+     return FindStartCodeAVX2;
+  if (__builtin_cpu_supports("sse2"))
+     return FindStartCodeSSE2;
+#endif
+  return FindStartCodeScalar;
+}
+
+static const tStartCodeScanner FindStartCode = SelectStartCodeScanner();
+
 // --- cRepacker -------------------------------------------------------------
 
 #define MIN_LOG_INTERVAL 10 // min. # of seconds between two consecutive log messages of a cRepacker
@@ -379,14 +463,12 @@ bool cVideoRepacker::ScanDataForStartCodeFast(const uchar *&Data, const uchar *L
 {
   Limit--;
 
-  while (Data < Limit && (Data = (const uchar *)memchr(Data, 0x01, Limit - Data))) {
-        if (Data[-2] || Data[-1])
-           Data += 3;
-        else {
-           scanner = 0x00000100 | *++Data;
-           return true;
-           }
-        }
+  const uchar *p = FindStartCode(Data, Limit);
+  if (p) {
+     Data = p;
+     scanner = 0x00000100 | *++Data;
+     return true;
+     }
 
   Data = Limit;
   uint32_t *Scanner = (uint32_t *)(Data - 3);
@@ -595,23 +677,19 @@ bool cVideoRepacker::ScanForEndOfPictureFast(const uchar *&Data, const uchar *Li
 {
   Limit--;
 
-  while (Data < Limit && (Data = (const uchar *)memchr(Data, 0x01, Limit - Data))) {
-        if (Data[-2] || Data[-1])
-           Data += 3;
-        else {
-           localScanner = 0x00000100 | *++Data;
-           // check start codes which follow picture data
-           switch (localScanner) {
-             case 0x00000100: // picture start code
-             case 0x000001B8: // group start code
-             case 0x000001B3: // sequence header code
-             case 0x000001B7: // sequence end code
-                  Data++;
-                  return true;
-             default:
-                  Data += 3;
-             }
-           }
+  while (Data < Limit && (Data = FindStartCode(Data, Limit))) {
+        localScanner = 0x00000100 | *++Data;
+        // check start codes which follow picture data
+        switch (localScanner) {
+          case 0x00000100: // picture start code
+          case 0x000001B8: // group start code
+          case 0x000001B3: // sequence header code
+          case 0x000001B7: // sequence end code
+               Data++;
+               return true;
+          default:
+               Data += 3;
+          }
         }
 
   Data = Limit + 1;
@@ -1413,7 +1491,6 @@ int cDolbyRepacker::BreakAt(const uchar *Data, int Count)
 //pts_dts flags
 #define PTS_ONLY         0x80
 
-#define TS_SIZE        188
 #define PID_MASK_HI    0x1F
 #define CONT_CNT_MASK  0x0F
 
@@ -1433,7 +1510,6 @@ int cDolbyRepacker::BreakAt(const uchar *Data, int Count)
 #define SC_GROUP    0xB8  // "group start code"
 #define SC_PICTURE  0x00  // "picture start code"
 
-#define MAXNONUSEFULDATA (10*1024*1024)
 #define MAXNUMUPTERRORS  10
 
 class cTS2PES {
@@ -1472,6 +1548,7 @@ public:
   ~cTS2PES();
   int Pid(void) { return pid; }
   void ts_to_pes(const uint8_t *Buf); // don't need count (=188)
+  void Flush(void);
   void Clear(void);
   };
 
@@ -1509,6 +1586,15 @@ cTS2PES::~cTS2PES()
   delete repacker;
 }
 
+void cTS2PES::Flush(void)
+{
+  if (found > 6) {
+     plength = found - 6;
+     send_ipack();
+     }
+  reset_ipack();
+}
+
 void cTS2PES::Clear(void)
 {
   reset_ipack();
@@ -1892,11 +1978,121 @@ int cRingBufferLinearPes::DataReady(const uchar *Data, int Count)
   return c;
 }
 
+// --- cRemuxWorker ----------------------------------------------------------
+
+#define REMUXBATCHSIZE  (64 * TS_SIZE) // max. amount of video TS data in one batch
+#define REMUXPESBUFSIZE KILOBYTE(256)  // PES output of a single batch
+#define REMUXFRAMESIZE  MEGABYTE(2)    // video data waiting to be converted or multiplexed
+
+class cRemuxWorker : public cThread {
+private:
+  cTS2PES *ts2pes;
+  cRingBufferLinear *pesBuffer;
+  cFramePool *framePool;
+  cRingBufferFrame *input;
+  cRingBufferFrame *output;
+  cCondWait newInput;
+protected:
+  virtual void Action(void);
+public:
+  cRemuxWorker(void);
+  virtual ~cRemuxWorker();
+  cRingBufferLinear *PesBuffer(void) { return pesBuffer; }
+  void SetTS2PES(cTS2PES *TS2PES) { ts2pes = TS2PES; }
+  uchar *NewBatch(void) { return framePool->Allocate(REMUXBATCHSIZE); }
+  void Process(uchar *Batch, int Count);
+       ///< Hands the given batch of video TS packets (obtained through NewBatch())
+       ///< over to the worker thread. The caller must make sure that no more than
+       ///< REMUXBATCHES batches are in the pipeline at any time.
+  cFrame *Result(void) { return output->Get(); }
+  void Drop(cFrame *Frame) { output->Drop(Frame); }
+  void Clear(void);
+       ///< Stops the worker thread and discards all batches. Start() must be
+       ///< called to resume operation.
+  };
+
+cRemuxWorker::cRemuxWorker(void)
+:cThread("remux worker")
+{
+  ts2pes = NULL;
+  pesBuffer = new cRingBufferLinear(REMUXPESBUFSIZE, 0, false, "Remux PES");
+  pesBuffer->SetTimeouts(0, 0);
+  framePool = new cFramePool(REMUXFRAMESIZE / 4);
+  input = new cRingBufferFrame((REMUXBATCHES + 1) * REMUXBATCHSIZE); // a cRingBuffer can't be filled completely
+  output = new cRingBufferFrame(REMUXFRAMESIZE);
+}
+
+cRemuxWorker::~cRemuxWorker()
+{
+  Cancel(3);
+  delete input;
+  delete output;
+  delete pesBuffer;
+  delete framePool;
+}
+
+void cRemuxWorker::Process(uchar *Batch, int Count)
+{
+  input->Put(framePool->NewFrame(Batch, Count, ftVideo));
+  newInput.Signal();
+}
+
+void cRemuxWorker::Clear(void)
+{
+  Cancel(3);
+  input->Clear();
+  output->Clear();
+  pesBuffer->Clear();
+}
+
+void cRemuxWorker::Action(void)
+{
+  while (Running()) {
+        cFrame *Frame = input->Get();
+        if (!Frame) {
+           newInput.Wait(100);
+           continue;
+           }
+        const uchar *Data = Frame->Data();
+        for (int i = 0; i + TS_SIZE <= Frame->Count(); i += TS_SIZE)
+            ts2pes->ts_to_pes(Data + i);
+        input->Drop(Frame);
+        // The result is handed on even if it is empty, because the multiplexer
+        // needs one frame per batch to keep the tracks in order:
+        int Count = pesBuffer->Available();
+        uchar *b = framePool->Allocate(Count);
+        if (!b)
+           break;
+        int Length = 0;
+        while (Length < Count) {
+              int n;
+              uchar *p = pesBuffer->Get(n);
+              if (!p)
+                 break;
+              if (n > Count - Length)
+                 n = Count - Length;
+              memcpy(b + Length, p, n);
+              pesBuffer->Del(n);
+              Length += n;
+              }
+        cFrame *Result = framePool->NewFrame(b, Length, ftVideo);
+        while (!output->Put(Result)) {
+              if (!Running()) {
+                 delete Result;
+                 return;
+                 }
+              cCondWait::SleepMs(3);
+              }
+        }
+}
+
 // --- cRemux ----------------------------------------------------------------
 
 #define RESULTBUFFERSIZE KILOBYTE(256)
 
-cRemux::cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure)
+static cMetricCounter RemuxBytes("remux.bytes");
+
+cRemux::cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure, bool Threaded)
 {
   exitOnFailure = ExitOnFailure;
   noVideo = VPid == 0 || VPid == 1 || VPid == 0x1FFF;
@@ -1907,41 +2103,62 @@ cRemux::cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, b
   resultSkipped = 0;
   resultBuffer = new cRingBufferLinearPes(RESULTBUFFERSIZE, IPACKS, false, "Result");
   resultBuffer->SetTimeouts(0, 100);
-  if (VPid)
+  resultBuffer->SetSingleProducerConsumer();
+  worker = NULL;
+  videoTS2PES = NULL;
+  pendingBuffer = NULL;
+  pendingQueued = 0;
+  firstBatch = numBatches = 0;
+  cRingBufferLinear *TrackBuffer = resultBuffer;
+  if (Threaded && VPid && !noVideo && sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+     worker = new cRemuxWorker;
+     pendingBuffer = new cRingBufferLinear(RESULTBUFFERSIZE, 0, false, "Remux pending");
+     pendingBuffer->SetTimeouts(0, 0);
+     pendingBuffer->SetSingleProducerConsumer();
+     TrackBuffer = pendingBuffer;
+     }
+  if (VPid) {
 #define TEST_cVideoRepacker
 #ifdef TEST_cVideoRepacker
-     ts2pes[numTracks++] = new cTS2PES(VPid, resultBuffer, IPACKS, 0xE0, 0x00, new cVideoRepacker);
+     ts2pes[numTracks++] = videoTS2PES = new cTS2PES(VPid, worker ? worker->PesBuffer() : resultBuffer, IPACKS, 0xE0, 0x00, new cVideoRepacker);
 #else
-     ts2pes[numTracks++] = new cTS2PES(VPid, resultBuffer, IPACKS, 0xE0);
+     ts2pes[numTracks++] = videoTS2PES = new cTS2PES(VPid, worker ? worker->PesBuffer() : resultBuffer, IPACKS, 0xE0);
 #endif
+     }
   if (APids) {
      int n = 0;
      while (*APids && numTracks < MAXTRACKS && n < MAXAPIDS) {
 #define TEST_cAudioRepacker
 #ifdef TEST_cAudioRepacker
-           ts2pes[numTracks++] = new cTS2PES(*APids++, resultBuffer, IPACKS, 0xC0 + n, 0x00, new cAudioRepacker(0xC0 + n));
+           ts2pes[numTracks++] = new cTS2PES(*APids++, TrackBuffer, IPACKS, 0xC0 + n, 0x00, new cAudioRepacker(0xC0 + n));
            n++;
 #else
-           ts2pes[numTracks++] = new cTS2PES(*APids++, resultBuffer, IPACKS, 0xC0 + n++);
+           ts2pes[numTracks++] = new cTS2PES(*APids++, TrackBuffer, IPACKS, 0xC0 + n++);
 #endif
            }
      }
   if (DPids) {
      int n = 0;
      while (*DPids && numTracks < MAXTRACKS && n < MAXDPIDS)
-           ts2pes[numTracks++] = new cTS2PES(*DPids++, resultBuffer, IPACKS, 0x00, 0x80 + n++, new cDolbyRepacker);
+           ts2pes[numTracks++] = new cTS2PES(*DPids++, TrackBuffer, IPACKS, 0x00, 0x80 + n++, new cDolbyRepacker);
      }
   if (SPids) {
      int n = 0;
      while (*SPids && numTracks < MAXTRACKS && n < MAXSPIDS)
-           ts2pes[numTracks++] = new cTS2PES(*SPids++, resultBuffer, IPACKS, 0x00, 0x20 + n++);
+           ts2pes[numTracks++] = new cTS2PES(*SPids++, TrackBuffer, IPACKS, 0x00, 0x20 + n++);
+     }
+  if (worker) {
+     worker->SetTS2PES(videoTS2PES);
+     worker->Start();
      }
 }
 
 cRemux::~cRemux()
 {
+  delete worker; // stops the thread before its cTS2PES goes away
   for (int t = 0; t < numTracks; t++)
       delete ts2pes[t];
+  delete pendingBuffer;
   delete resultBuffer;
 }
 
@@ -1989,16 +2206,12 @@ int cRemux::ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &Pic
               }
            }
 #endif
-        while (p < pLimit && (p = (const uchar *)memchr(p, 0x01, pLimit - p))) {
-              if (!p[-2] && !p[-1]) { // found 0x000001
-                 switch (p[1]) {
-                   case SC_PICTURE: PictureType = (p[3] >> 3) & 0x07;
-                                    return Length;
-                   }
-                 p += 4; // continue scanning after 0x01ssxxyy
-                 }
-              else
-                 p += 3; // continue scanning after 0x01xxyy
+        while (p < pLimit && (p = FindStartCode(p, pLimit))) { // found 0x000001
+              switch (p[1]) {
+                case SC_PICTURE: PictureType = (p[3] >> 3) & 0x07;
+                                 return Length;
+                }
+              p += 4; // continue scanning after 0x01ssxxyy
               }
         }
      PictureType = NO_PICTURE;
@@ -2007,8 +2220,6 @@ int cRemux::ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &Pic
   return -1;
 }
 
-#define TS_SYNC_BYTE 0x47
-
 int cRemux::Put(const uchar *Data, int Count)
 {
   int used = 0;
@@ -2018,33 +2229,66 @@ int cRemux::Put(const uchar *Data, int Count)
   while (Count > TS_SIZE) {
         if (Data[0] == TS_SYNC_BYTE && Data[TS_SIZE] == TS_SYNC_BYTE)
            break;
-        Data++;
-        Count--;
-        used++;
+        // memchr() is vectorized by the C library, so let it find the next candidate:
+        const uchar *p = (const uchar *)memchr(Data + 1, TS_SYNC_BYTE, Count - TS_SIZE - 1);
+        int Skip = p ? p - Data : Count - TS_SIZE;
+        Data += Skip;
+        Count -= Skip;
+        used += Skip;
         }
   if (used)
      esyslog("ERROR: skipped %d byte to sync on TS packet", used);
 
   // Convert incoming TS data into multiplexed PES:
 
+  uchar *Batch = NULL;
+  int BatchCount = 0;
+  if (worker) {
+     Mux();
+     if (numBatches >= REMUXBATCHES)
+        Count = 0; // the pipeline is full
+     }
   for (int i = 0; i < Count; i += TS_SIZE) {
       if (Count - i < TS_SIZE)
          break;
       if (Data[i] != TS_SYNC_BYTE)
          break;
-      if (resultBuffer->Free() < 2 * IPACKS)
+      if (worker) {
+         if (BatchCount >= REMUXBATCHSIZE) {
+            QueueBatch(Batch, BatchCount);
+            if (numBatches >= REMUXBATCHES) {
+               Mux();
+               if (numBatches >= REMUXBATCHES)
+                  break;
+               }
+            }
+         if (pendingBuffer->Free() < 2 * IPACKS)
+            break;
+         }
+      else if (resultBuffer->Free() < 2 * IPACKS)
          break; // A cTS2PES might write one full packet and also a small rest
       int pid = GetPid(Data + i + 1);
       if (Data[i + 3] & 0x10) { // got payload
          for (int t = 0; t < numTracks; t++) {
              if (ts2pes[t]->Pid() == pid) {
-                ts2pes[t]->ts_to_pes(Data + i);
+                if (worker && ts2pes[t] == videoTS2PES) {
+                   if (!Batch && (Batch = worker->NewBatch()) == NULL)
+                      return used;
+                   memcpy(Batch + BatchCount, Data + i, TS_SIZE);
+                   BatchCount += TS_SIZE;
+                   }
+                else
+                   ts2pes[t]->ts_to_pes(Data + i);
                 break;
                 }
              }
          }
       used += TS_SIZE;
       }
+  if (worker) {
+     QueueBatch(Batch, BatchCount);
+     Mux();
+     }
 
   // Check if we're getting anywhere here:
   if (!synced && skipped >= 0) {
@@ -2058,11 +2302,65 @@ int cRemux::Put(const uchar *Data, int Count)
         skipped += used;
      }
 
+  RemuxBytes.Add(used);
   return used;
 }
 
+void cRemux::QueueBatch(uchar *&Batch, int &Count)
+{
+  cMutexLock MutexLock(&muxMutex);
+  int PesLength = pendingBuffer->Available() - pendingQueued;
+  if (Count || PesLength) {
+     tRemuxBatch *b = &batches[(firstBatch + numBatches++) % REMUXBATCHES];
+     b->pesLength = PesLength;
+     b->video = Count > 0;
+     pendingQueued += PesLength;
+     if (Count)
+        worker->Process(Batch, Count);
+     Batch = NULL;
+     Count = 0;
+     }
+}
+
+void cRemux::Mux(void)
+{
+  // Called from both Put() and Get(), so the mutex makes sure there is only
+  // one producer for the result buffer at any time:
+  cMutexLock MutexLock(&muxMutex);
+  while (numBatches > 0) {
+        tRemuxBatch *b = &batches[firstBatch];
+        cFrame *Frame = NULL;
+        if (b->video && (Frame = worker->Result()) == NULL)
+           break; // the worker is still busy with this batch
+        if (resultBuffer->Free() < (Frame ? Frame->Count() : 0) + b->pesLength)
+           break;
+        if (Frame) {
+           resultBuffer->Put(Frame->Data(), Frame->Count());
+           worker->Drop(Frame);
+           }
+        int Length = b->pesLength;
+        while (Length > 0) {
+              int n;
+              uchar *p = pendingBuffer->Get(n);
+              if (!p)
+                 break;
+              if (n > Length)
+                 n = Length;
+              resultBuffer->Put(p, n);
+              pendingBuffer->Del(n);
+              Length -= n;
+              }
+        pendingQueued -= b->pesLength;
+        firstBatch = (firstBatch + 1) % REMUXBATCHES;
+        numBatches--;
+        }
+}
+
 uchar *cRemux::Get(int &Count, uchar *PictureType)
 {
+  if (worker)
+     Mux();
+
   // Remove any previously skipped data from the result buffer:
 
   if (resultSkipped > 0) {
@@ -2158,9 +2456,18 @@ void cRemux::Del(int Count)
 
 void cRemux::Clear(void)
 {
+  if (worker) {
+     cMutexLock MutexLock(&muxMutex);
+     worker->Clear();
+     pendingBuffer->Clear();
+     pendingQueued = 0;
+     firstBatch = numBatches = 0;
+     }
   for (int t = 0; t < numTracks; t++)
       ts2pes[t]->Clear();
   resultBuffer->Clear();
+  if (worker)
+     worker->Start();
   synced = false;
   skipped = 0;
   resultSkipped = 0;
@@ -2182,3 +2489,358 @@ void cRemux::SetBrokenLink(uchar *Data, int Length)
   else
      dsyslog("SetBrokenLink: no video packet in frame");
 }
+
+// --- TS recordings ---------------------------------------------------------
+
+bool TsPictureType(const uchar *Data, int Count, uchar &PictureType)
+{
+  uchar Payload[TSPICTURESCAN];
+  int Length = 0;
+  int Pid = TsPid(Data);
+  PictureType = NO_PICTURE;
+  for (int i = 0; i + TS_SIZE <= Count; i += TS_SIZE) {
+      const uchar *p = Data + i;
+      if (i >= TSPICTURESCAN || p[0] != TS_SYNC_BYTE)
+         return true;
+      if (TsPid(p) != Pid || !TsHasPayload(p))
+         continue;
+      if (i && TsPayloadStart(p))
+         return true; // the next PES packet starts without a picture in this one
+      int o = TsPayloadOffset(p);
+      if (o >= TS_SIZE)
+         continue;
+      int Start = max(Length - 3, 2); // a start code may span two packets
+      memcpy(Payload + Length, p + o, TS_SIZE - o);
+      Length += TS_SIZE - o;
+      const uchar *s = Payload + Start;
+      const uchar *Limit = Payload + Length - 3;
+      while (s < Limit && (s = FindStartCode(s, Limit))) { // found 0x000001
+            if (s[1] == SC_PICTURE) {
+               PictureType = (s[3] >> 3) & 0x07;
+               return true;
+               }
+            s += 4;
+            }
+      }
+  return Count >= TSPICTURESCAN;
+}
+
+void TsSetBrokenLink(uchar *Data, int Length)
+{
+  int Pid = -1;
+  for (int i = 0; i + TS_SIZE <= Length; i += TS_SIZE) {
+      uchar *p = Data + i;
+      if (p[0] != TS_SYNC_BYTE)
+         break;
+      if (!TsHasPayload(p))
+         continue;
+      int o = TsPayloadOffset(p);
+      if (o >= TS_SIZE)
+         continue;
+      if (Pid < 0) {
+         // Look for the first video PES packet:
+         if (!TsPayloadStart(p) || TS_SIZE - o < 4 || p[o] != 0 || p[o + 1] != 0 || p[o + 2] != 1 || (p[o + 3] & 0xF0) != VIDEO_STREAM_S)
+            continue;
+         Pid = TsPid(p);
+         }
+      else if (TsPid(p) != Pid)
+         continue;
+      else if (TsPayloadStart(p))
+         break; // the next PES packet starts without a GOP header in this one
+      for (int j = o; j < TS_SIZE - 7; j++) {
+          if (p[j] == 0 && p[j + 1] == 0 && p[j + 2] == 1 && p[j + 3] == SC_GROUP) {
+             if (!(p[j + 7] & 0x40)) // set flag only if GOP is not closed
+                p[j + 7] |= 0x20;
+             return;
+             }
+          }
+      }
+  dsyslog("TsSetBrokenLink: no GOP header found in video packet");
+}
+
+// --- cPatPmtGenerator ------------------------------------------------------
+
+#define TSPMTPID        0x0084 // the PMT is put into the first free PID from here on
+#define TSMAXSECTION    (TS_SIZE - 5) // a section must fit into one packet after the pointer field
+
+#define STREAMTYPE_MPEG2_VIDEO 0x02
+#define STREAMTYPE_MPEG2_AUDIO 0x04
+#define STREAMTYPE_PRIVATE     0x06
+
+static void SetSectionCrc(uchar *Section, int Length)
+{
+  // Length includes the four bytes of the CRC:
+  uint32_t crc = SI::CRC32::crc32((const char *)Section, Length - 4, 0xFFFFFFFF);
+  Section[Length - 4] = crc >> 24;
+  Section[Length - 3] = crc >> 16;
+  Section[Length - 2] = crc >> 8;
+  Section[Length - 1] = crc;
+}
+
+static int AddStream(uchar *p, int Type, int Pid, const uchar *Descriptor = NULL, int DescriptorLength = 0)
+{
+  p[0] = Type;
+  p[1] = 0xE0 | (Pid >> 8);
+  p[2] = Pid;
+  p[3] = 0xF0;
+  p[4] = DescriptorLength;
+  if (DescriptorLength)
+     memcpy(p + 5, Descriptor, DescriptorLength);
+  return 5 + DescriptorLength;
+}
+
+static bool UsesPid(int Pid, int VPid, const int *APids, const int *DPids, const int *SPids)
+{
+  if (Pid == VPid)
+     return true;
+  const int *Pids[] = { APids, DPids, SPids };
+  for (unsigned int i = 0; i < sizeof(Pids) / sizeof(Pids[0]); i++) {
+      for (const int *p = Pids[i]; p && *p; p++) {
+          if (*p == Pid)
+             return true;
+          }
+      }
+  return false;
+}
+
+cPatPmtGenerator::cPatPmtGenerator(int VPid, const int *APids, const int *DPids, const int *SPids)
+{
+  counter = 0;
+  int PmtPid = TSPMTPID;
+  while (UsesPid(PmtPid, VPid, APids, DPids, SPids))
+        PmtPid++;
+  // PAT:
+  memset(pat, 0xFF, sizeof(pat));
+  uchar *p = pat;
+  *p++ = TS_SYNC_BYTE;
+  *p++ = 0x40; // payload unit start, PID 0
+  *p++ = 0x00;
+  *p++ = 0x10; // payload only
+  *p++ = 0x00; // pointer field
+  uchar *s = p;
+  *p++ = 0x00; // table id
+  *p++ = 0xB0; // section syntax, length (filled in below)
+  *p++ = 0x00;
+  *p++ = 0x00; // transport stream id
+  *p++ = 0x01;
+  *p++ = 0xC1; // version 0, current
+  *p++ = 0x00; // section number
+  *p++ = 0x00; // last section number
+  *p++ = 0x00; // program number
+  *p++ = 0x01;
+  *p++ = 0xE0 | (PmtPid >> 8);
+  *p++ = PmtPid;
+  p += 4; // CRC
+  s[2] = p - s - 3;
+  SetSectionCrc(s, p - s);
+  // PMT:
+  memset(pmt, 0xFF, sizeof(pmt));
+  p = pmt;
+  *p++ = TS_SYNC_BYTE;
+  *p++ = 0x40 | (PmtPid >> 8);
+  *p++ = PmtPid;
+  *p++ = 0x10;
+  *p++ = 0x00; // pointer field
+  s = p;
+  int PcrPid = VPid ? VPid : (APids && *APids) ? *APids : 0x1FFF;
+  *p++ = 0x02; // table id
+  *p++ = 0xB0; // section syntax, length (filled in below)
+  *p++ = 0x00;
+  *p++ = 0x00; // program number
+  *p++ = 0x01;
+  *p++ = 0xC1; // version 0, current
+  *p++ = 0x00; // section number
+  *p++ = 0x00; // last section number
+  *p++ = 0xE0 | (PcrPid >> 8);
+  *p++ = PcrPid;
+  *p++ = 0xF0; // program info length
+  *p++ = 0x00;
+  uchar *Limit = s + TSMAXSECTION - 4;
+  if (VPid)
+     p += AddStream(p, STREAMTYPE_MPEG2_VIDEO, VPid);
+  for (; APids && *APids && p + 5 <= Limit; APids++)
+      p += AddStream(p, STREAMTYPE_MPEG2_AUDIO, *APids);
+  static const uchar Ac3Descriptor[] = { 0x6A, 0x01, 0x00 };
+  for (; DPids && *DPids && p + 5 + sizeof(Ac3Descriptor) <= Limit; DPids++)
+      p += AddStream(p, STREAMTYPE_PRIVATE, *DPids, Ac3Descriptor, sizeof(Ac3Descriptor));
+  static const uchar SubtitlingDescriptor[] = { 0x59, 0x08, 'u', 'n', 'd', 0x10, 0x00, 0x01, 0x00, 0x01 };
+  for (; SPids && *SPids && p + 5 + sizeof(SubtitlingDescriptor) <= Limit; SPids++)
+      p += AddStream(p, STREAMTYPE_PRIVATE, *SPids, SubtitlingDescriptor, sizeof(SubtitlingDescriptor));
+  if ((APids && *APids) || (DPids && *DPids) || (SPids && *SPids))
+     esyslog("ERROR: too many PIDs for PMT - some tracks will not be replayed");
+  p += 4; // CRC
+  s[1] |= (p - s - 3) >> 8;
+  s[2] = p - s - 3;
+  SetSectionCrc(s, p - s);
+}
+
+const uchar *cPatPmtGenerator::Get(void)
+{
+  pat[3] = (pat[3] & 0xF0) | (counter & 0x0F);
+  pmt[3] = (pmt[3] & 0xF0) | (counter & 0x0F);
+  counter++;
+  memcpy(patPmt, pat, TS_SIZE);
+  memcpy(patPmt + TS_SIZE, pmt, TS_SIZE);
+  return patPmt;
+}
+
+// --- cPatPmtParser ---------------------------------------------------------
+
+cPatPmtParser::cPatPmtParser(void)
+{
+  pmtPid = -1;
+  pmtVersion = -1;
+  vpid = 0;
+  apids[0] = dpids[0] = spids[0] = 0;
+}
+
+bool cPatPmtParser::Parse(const uchar *Data, int Count)
+{
+  bool NewPmt = false;
+  for (int i = 0; i + TS_SIZE <= Count; i += TS_SIZE) {
+      const uchar *p = Data + i;
+      if (p[0] != TS_SYNC_BYTE || !TsPayloadStart(p) || !TsHasPayload(p))
+         continue;
+      int Pid = TsPid(p);
+      if (Pid != 0 && Pid != pmtPid)
+         continue;
+      int o = TsPayloadOffset(p);
+      if (o >= TS_SIZE)
+         continue;
+      o += p[o] + 1; // pointer field
+      if (o + 3 > TS_SIZE)
+         continue;
+      const uchar *s = p + o;
+      int Length = (((s[1] & 0x0F) << 8) | s[2]) + 3;
+      if (Length < 12 || o + Length > TS_SIZE || !SI::CRC32::isValid((const char *)s, Length))
+         continue;
+      if (Pid == 0 && s[0] == 0x00) { // PAT
+         for (int j = 8; j + 4 <= Length - 4; j += 4) {
+             if (s[j] || s[j + 1]) { // the first program that is not the NIT
+                pmtPid = ((s[j + 2] & 0x1F) << 8) | s[j + 3];
+                break;
+                }
+             }
+         }
+      else if (Pid == pmtPid && s[0] == 0x02) { // PMT
+         int Version = (s[5] >> 1) & 0x1F;
+         if (Version == pmtVersion)
+            continue;
+         pmtVersion = Version;
+         vpid = 0;
+         int na = 0, nd = 0, ns = 0;
+         int j = 12 + (((s[10] & 0x0F) << 8) | s[11]);
+         while (j + 5 <= Length - 4) {
+               int Type = s[j];
+               int EsPid = ((s[j + 1] & 0x1F) << 8) | s[j + 2];
+               int EsInfoLength = ((s[j + 3] & 0x0F) << 8) | s[j + 4];
+               const uchar *d = s + j + 5;
+               const uchar *dLimit = min(d + EsInfoLength, s + Length - 4);
+               switch (Type) {
+                 case 0x01:
+                 case 0x02: if (!vpid)
+                               vpid = EsPid;
+                            break;
+                 case 0x03:
+                 case 0x04: if (na < MAXTRACKS)
+                               apids[na++] = EsPid;
+                            break;
+                 case 0x06: for (; d + 2 <= dLimit; d += d[1] + 2) {
+                                if ((d[0] == 0x6A || d[0] == 0x7A) && nd < MAXTRACKS) { // AC-3 or enhanced AC-3
+                                   dpids[nd++] = EsPid;
+                                   break;
+                                   }
+                                if (d[0] == 0x59 && ns < MAXTRACKS) { // subtitling
+                                   spids[ns++] = EsPid;
+                                   break;
+                                   }
+                                }
+                            break;
+                 default: ;
+                 }
+               j += 5 + EsInfoLength;
+               }
+         apids[na] = dpids[nd] = spids[ns] = 0;
+         NewPmt = true;
+         }
+      }
+  return NewPmt;
+}
+
+// --- cTsToPes --------------------------------------------------------------
+
+#define TSTOPESBUFSIZE MEGABYTE(1)
+
+cTsToPes::cTsToPes(void)
+{
+  numTracks = 0;
+  resultBuffer = new cRingBufferLinear(TSTOPESBUFSIZE, 0, false, "TS to PES");
+  resultBuffer->SetTimeouts(0, 0);
+}
+
+cTsToPes::~cTsToPes()
+{
+  for (int t = 0; t < numTracks; t++)
+      delete ts2pes[t];
+  delete resultBuffer;
+}
+
+void cTsToPes::SetPids(int VPid, const int *APids, const int *DPids, const int *SPids)
+{
+  // The tracks are converted without repackers, because Flush() must be able
+  // to push out everything right away:
+  for (int t = 0; t < numTracks; t++)
+      delete ts2pes[t];
+  numTracks = 0;
+  if (VPid)
+     ts2pes[numTracks++] = new cTS2PES(VPid, resultBuffer, IPACKS, 0xE0);
+  for (int n = 0; APids && *APids && numTracks < MAXTRACKS && n < MAXAPIDS; n++)
+      ts2pes[numTracks++] = new cTS2PES(*APids++, resultBuffer, IPACKS, 0xC0 + n);
+  for (int n = 0; DPids && *DPids && numTracks < MAXTRACKS && n < MAXDPIDS; n++)
+      ts2pes[numTracks++] = new cTS2PES(*DPids++, resultBuffer, IPACKS, 0x00, 0x80 + n);
+  for (int n = 0; SPids && *SPids && numTracks < MAXTRACKS && n < MAXSPIDS; n++)
+      ts2pes[numTracks++] = new cTS2PES(*SPids++, resultBuffer, IPACKS, 0x00, 0x20 + n);
+}
+
+int cTsToPes::Put(const uchar *Data, int Count)
+{
+  int used = 0;
+  for (; used + TS_SIZE <= Count; used += TS_SIZE) {
+      const uchar *p = Data + used;
+      if (resultBuffer->Free() < 2 * IPACKS)
+         break; // A cTS2PES might write one full packet and also a small rest
+      if (p[0] == TS_SYNC_BYTE && TsHasPayload(p)) {
+         int Pid = TsPid(p);
+         for (int t = 0; t < numTracks; t++) {
+             if (ts2pes[t]->Pid() == Pid) {
+                ts2pes[t]->ts_to_pes(p);
+                break;
+                }
+             }
+         }
+      }
+  return used;
+}
+
+uchar *cTsToPes::Get(int &Count)
+{
+  return resultBuffer->Get(Count);
+}
+
+void cTsToPes::Del(int Count)
+{
+  resultBuffer->Del(Count);
+}
+
+void cTsToPes::Flush(void)
+{
+  for (int t = 0; t < numTracks; t++)
+      ts2pes[t]->Flush();
+}
+
+void cTsToPes::Clear(void)
+{
+  for (int t = 0; t < numTracks; t++)
+      ts2pes[t]->Clear();
+  resultBuffer->Clear();
+}
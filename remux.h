@@ -10,6 +10,7 @@
 #ifndef __REMUX_H
 #define __REMUX_H
 
+#include "device.h"
 #include "ringbuffer.h"
 #include "tools.h"
 
@@ -30,8 +31,19 @@ ePesHeader AnalyzePesHeader(const uchar *Data, int Count, int &PesPayloadOffset,
 
 #define MAXTRACKS 64
 
+#define MAXNONUSEFULDATA (10*1024*1024) // max. amount of data a recording may contain without anything useful in it
+
 class cTS2PES;
 
+#define REMUXBATCHES 32 // max. number of TS batches in the threaded remux pipeline
+
+class cRemuxWorker;
+
+struct tRemuxBatch {
+  int pesLength; // number of bytes in the pending buffer that belong to this batch
+  bool video;    // true if the worker will deliver video data for this batch
+  };
+
 class cRemux {
 private:
   bool exitOnFailure;
@@ -43,14 +55,28 @@ private:
   int numTracks;
   cRingBufferLinear *resultBuffer;
   int resultSkipped;
+  cRemuxWorker *worker;
+  cTS2PES *videoTS2PES;
+  cRingBufferLinear *pendingBuffer;
+  int pendingQueued;
+  tRemuxBatch batches[REMUXBATCHES];
+  int firstBatch;
+  int numBatches;
+  cMutex muxMutex;
   int GetPid(const uchar *Data);
+  void QueueBatch(uchar *&Batch, int &Count);
+  void Mux(void);
 public:
-  cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure = false);
+  cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure = false, bool Threaded = false);
        ///< Creates a new remuxer for the given PIDs. VPid is the video PID, while
        ///< APids, DPids and SPids are pointers to zero terminated lists of audio,
        ///< dolby and subtitle PIDs (the pointers may be NULL if there is no such
        ///< PID). If ExitOnFailure is true, the remuxer will initiate an "emergency
        ///< exit" in case of problems with the data stream.
+       ///< If Threaded is true (and there is more than one CPU), the video track
+       ///< is converted in a separate thread, while the other tracks are handled
+       ///< in Put() as usual. The results are multiplexed in the same order as
+       ///< the TS packets came in, in batches of up to 64 video packets.
   ~cRemux();
   void SetTimeouts(int PutTimeout, int GetTimeout) { resultBuffer->SetTimeouts(PutTimeout, GetTimeout); }
        ///< By default cRemux assumes that Put() and Get() are called from different
@@ -79,4 +105,87 @@ public:
   static int ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &PictureType);
   };
 
+// --- TS recordings ---------------------------------------------------------
+
+// A TS recording contains the TS packets of the recorded PIDs as they came in.
+// Every I-frame is preceded by a PAT and a PMT, so that replay can start at
+// any I-frame, and the files can be used by any TS capable player as they are.
+
+#define TSPICTURESCAN (32 * TS_SIZE) // max. amount of data TsPictureType() looks at
+
+inline int TsPid(const uchar *p) { return (p[1] & 0x1F) << 8 | p[2]; }
+inline bool TsPayloadStart(const uchar *p) { return p[1] & 0x40; }
+inline bool TsHasPayload(const uchar *p) { return p[3] & 0x10; }
+inline int TsPayloadOffset(const uchar *p) { return (p[3] & 0x20) ? p[4] + 5 : 4; }
+inline bool TsIsScrambled(const uchar *p) { return p[3] & 0xC0; }
+
+bool TsPictureType(const uchar *Data, int Count, uchar &PictureType);
+     ///< Data must point to a TS packet that starts a video PES packet. Looks for
+     ///< the picture start code in this packet and the following ones with the
+     ///< same PID, and sets PictureType to I_FRAME, P_FRAME, B_FRAME or NO_PICTURE.
+     ///< \return Returns false if Count is less than TSPICTURESCAN and doesn't
+     ///< contain enough packets to tell.
+void TsSetBrokenLink(uchar *Data, int Length);
+     ///< Sets the broken_link flag in the GOP header of the first video PES packet
+     ///< in the TS packets in Data (the TS counterpart of cRemux::SetBrokenLink()).
+
+class cPatPmtGenerator {
+private:
+  uchar pat[TS_SIZE];
+  uchar pmt[TS_SIZE];
+  uchar patPmt[2 * TS_SIZE];
+  int counter;
+public:
+  cPatPmtGenerator(int VPid, const int *APids, const int *DPids, const int *SPids);
+  const uchar *Get(void);
+       ///< Returns a PAT and a PMT packet (2 * TS_SIZE bytes) describing the PIDs
+       ///< given in the constructor. Every call increments the continuity counters.
+  };
+
+class cPatPmtParser {
+private:
+  int pmtPid;
+  int pmtVersion;
+  int vpid;
+  int apids[MAXTRACKS + 1];
+  int dpids[MAXTRACKS + 1];
+  int spids[MAXTRACKS + 1];
+public:
+  cPatPmtParser(void);
+  bool Parse(const uchar *Data, int Count);
+       ///< Parses any PAT and PMT packets in the given TS data.
+       ///< \return Returns true if a new PMT has been found, in which case the
+       ///< PIDs it describes can be retrieved with Vpid(), Apids() etc.
+  int Vpid(void) const { return vpid; }
+  const int *Apids(void) const { return apids; }
+  const int *Dpids(void) const { return dpids; }
+  const int *Spids(void) const { return spids; }
+  };
+
+class cTsToPes {
+private:
+  cTS2PES *ts2pes[MAXTRACKS];
+  int numTracks;
+  cRingBufferLinear *resultBuffer;
+public:
+  cTsToPes(void);
+  ~cTsToPes();
+  void SetPids(int VPid, const int *APids, const int *DPids, const int *SPids);
+       ///< Sets the PIDs to convert, with the same meaning as in cRemux.
+  int Put(const uchar *Data, int Count);
+       ///< Converts TS packets from Data into PES packets.
+       ///< \return Returns the number of bytes actually consumed from Data.
+  int Available(void) { return resultBuffer->Available(); }
+  uchar *Get(int &Count);
+       ///< Gets the PES data that is currently available, without looking for
+       ///< frame borders. The data must be deleted with Del().
+  void Del(int Count);
+  void Flush(void);
+       ///< Pushes out any partial PES packets, so that Get() returns everything
+       ///< that has been Put() so far. Subsequent data is only converted from the
+       ///< next start of a PES packet on (as needed when skipping through a
+       ///< recording in trick modes).
+  void Clear(void);
+  };
+
 #endif // __REMUX_H
@@ -12,15 +12,35 @@
 
 #include "ringbuffer.h"
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include "metrics.h"
 #include "tools.h"
 
+// Memory ordering for the head/tail indexes, which are shared between the
+// producer and the consumer thread without any locking:
+
+#if __GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 7
+#define LOAD_ACQUIRE(v)     __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#define MEMORY_BARRIER()    __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+static inline int LoadAcquire(const int &v) { int x = *(const volatile int *)&v; __sync_synchronize(); return x; }
+#define LOAD_ACQUIRE(v)     LoadAcquire(v)
+#define STORE_RELEASE(v, x) do { __sync_synchronize(); *(volatile int *)&(v) = (x); } while (0)
+#define MEMORY_BARRIER()    __sync_synchronize()
+#endif
+
 // --- cRingBuffer -----------------------------------------------------------
 
 #define OVERFLOWREPORTDELTA 5 // seconds between reports
 #define PERCENTAGEDELTA     10
 #define PERCENTAGETHRESHOLD 70
 
+static cMetricHistogram FillPercent("ringbuffer.fill_percent", 5); // only buffers with statistics
+static cMetricCounter Overflows("ringbuffer.overflows");
+static cMetricCounter OverflowBytes("ringbuffer.overflow_bytes");
+
 cRingBuffer::cRingBuffer(int Size, bool Statistics)
 {
   size = Size;
@@ -29,6 +49,8 @@ cRingBuffer::cRingBuffer(int Size, bool Statistics)
   maxFill = 0;
   lastPercent = 0;
   putTimeout = getTimeout = 0;
+  singleProducerConsumer = false;
+  waitingForPut = waitingForGet = 0;
   lastOverflowReport = 0;
   overflowCount = overflowBytes = 0;
 }
@@ -43,6 +65,7 @@ void cRingBuffer::UpdatePercentage(int Fill)
 {
   if (Fill > maxFill)
      maxFill = Fill;
+  FillPercent.Observe(Fill * 100LL / (Size() - 1));
   int percent = Fill * 100 / (Size() - 1) / PERCENTAGEDELTA * PERCENTAGEDELTA;
   if (percent != lastPercent) {
      if (percent >= PERCENTAGETHRESHOLD && percent > lastPercent || percent < PERCENTAGETHRESHOLD && lastPercent >= PERCENTAGETHRESHOLD) {
@@ -54,26 +77,62 @@ void cRingBuffer::UpdatePercentage(int Fill)
 
 void cRingBuffer::WaitForPut(void)
 {
-  if (putTimeout)
+  if (putTimeout) {
+     if (singleProducerConsumer) {
+        // Announce that we are about to wait and check again, so that the
+        // consumer either sees our flag or we see the space it has freed:
+        waitingForPut = 1;
+        MEMORY_BARRIER();
+        if (Free() > Size() / 3) {
+           waitingForPut = 0;
+           return;
+           }
+        }
      readyForPut.Wait(putTimeout);
+     waitingForPut = 0;
+     }
 }
 
 void cRingBuffer::WaitForGet(void)
 {
-  if (getTimeout)
+  if (getTimeout) {
+     if (singleProducerConsumer) {
+        waitingForGet = 1;
+        MEMORY_BARRIER();
+        if (Available() > Size() / 3) {
+           waitingForGet = 0;
+           return;
+           }
+        }
      readyForGet.Wait(getTimeout);
+     waitingForGet = 0;
+     }
 }
 
 void cRingBuffer::EnablePut(void)
 {
-  if (putTimeout && Free() > Size() / 3)
+  if (putTimeout && Free() > Size() / 3) {
+     if (singleProducerConsumer) {
+        MEMORY_BARRIER();
+        if (!waitingForPut)
+           return;
+        waitingForPut = 0;
+        }
      readyForPut.Signal();
+     }
 }
 
 void cRingBuffer::EnableGet(void)
 {
-  if (getTimeout && Available() > Size() / 3)
+  if (getTimeout && Available() > Size() / 3) {
+     if (singleProducerConsumer) {
+        MEMORY_BARRIER();
+        if (!waitingForGet)
+           return;
+        waitingForGet = 0;
+        }
      readyForGet.Signal();
+     }
 }
 
 void cRingBuffer::SetTimeouts(int PutTimeout, int GetTimeout)
@@ -82,10 +141,17 @@ void cRingBuffer::SetTimeouts(int PutTimeout, int GetTimeout)
   getTimeout = GetTimeout;
 }
 
+void cRingBuffer::SetSingleProducerConsumer(bool On)
+{
+  singleProducerConsumer = On;
+}
+
 void cRingBuffer::ReportOverflow(int Bytes)
 {
   overflowCount++;
   overflowBytes += Bytes;
+  Overflows.Add();
+  OverflowBytes.Add(Bytes);
   if (time(NULL) - lastOverflowReport > OVERFLOWREPORTDELTA) {
      esyslog("ERROR: %d ring buffer overflow%s (%d bytes dropped)", overflowCount, overflowCount > 1 ? "s" : "", overflowBytes);
      overflowCount = overflowBytes = 0;
@@ -93,6 +159,34 @@ void cRingBuffer::ReportOverflow(int Bytes)
      }
 }
 
+// --- cRingBufferBudget -----------------------------------------------------
+
+cRingBufferBudget::cRingBufferBudget(int Limit)
+{
+  limit = Limit;
+  used = 0;
+}
+
+void cRingBufferBudget::SetLimit(int Limit)
+{
+  cMutexLock MutexLock(&mutex);
+  limit = Limit;
+}
+
+int cRingBufferBudget::Acquire(int Bytes)
+{
+  cMutexLock MutexLock(&mutex);
+  Bytes = max(0, min(Bytes, limit - used));
+  used += Bytes;
+  return Bytes;
+}
+
+void cRingBufferBudget::Release(int Bytes)
+{
+  cMutexLock MutexLock(&mutex);
+  used -= Bytes;
+}
+
 // --- cRingBufferLinear -----------------------------------------------------
 
 #ifdef DEBUGRINGBUFFERS
@@ -151,16 +245,44 @@ void cRingBufferLinear::PrintDebugRBL(void)
   }
 #endif
 
-cRingBufferLinear::cRingBufferLinear(int Size, int Margin, bool Statistics, const char *Description)
+#define RBGROWSTEP        KILOBYTE(64) // growable buffers change their size in multiples of this
+#define RBGROWTHRESHOLD   50 // % fill at which a growable buffer grows
+#define RBSHRINKTHRESHOLD 10 // % fill below which a growable buffer may shrink...
+#define RBSHRINKDELAY     60 // ...after this many seconds
+
+static cMetricCounter GrownBytes("ringbuffer.grown_bytes"); // the sum of what growable buffers currently have above their initial sizes
+
+cRingBufferLinear::cRingBufferLinear(int Size, int Margin, bool Statistics, const char *Description, int MaxSize)
 :cRingBuffer(Size, Statistics)
 {
   description = Description ? strdup(Description) : NULL;
   tail = head = margin = Margin;
   gotten = 0;
   buffer = NULL;
+  initialSize = maxSize = 0;
+  pendingSize = 0;
+  budget = NULL;
+  lowFillSince = 0;
   if (Size > 1) { // 'Size - 1' must not be 0!
      if (Margin <= Size / 2) {
-        buffer = MALLOC(uchar, Size);
+        if (MaxSize > Size) {
+           // The whole address space is reserved up front, so that the buffer
+           // can grow in place. Pages are only backed by memory when they are
+           // first written to:
+           Size = (Size + RBGROWSTEP - 1) / RBGROWSTEP * RBGROWSTEP;
+           MaxSize = max(MaxSize / RBGROWSTEP * RBGROWSTEP, Size);
+           void *p = mmap(NULL, MaxSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+           if (p != MAP_FAILED) {
+              buffer = (uchar *)p;
+              SetSize(Size);
+              initialSize = Size;
+              maxSize = MaxSize;
+              }
+           else
+              LOG_ERROR;
+           }
+        if (!buffer)
+           buffer = MALLOC(uchar, Size);
         if (!buffer)
            esyslog("ERROR: can't allocate ring buffer (size=%d)", Size);
         Clear();
@@ -183,10 +305,85 @@ cRingBufferLinear::~cRingBufferLinear()
 #ifdef DEBUGRINGBUFFERS
   DelDebugRBL(this);
 #endif
-  free(buffer);
+  if (maxSize) {
+     int Grown = max(Size(), pendingSize) - initialSize;
+     if (budget)
+        budget->Release(Grown);
+     GrownBytes.Add(-Grown);
+     munmap(buffer, maxSize);
+     }
+  else
+     free(buffer);
   free(description);
 }
 
+void cRingBufferLinear::Resize(int Tail, int Count)
+{
+  // This is only called by the producer. While the data doesn't wrap around
+  // the end of the buffer, the consumer won't look at the size until it has
+  // seen a new head, which is stored with release semantics after the new
+  // size. While the data wraps around, the size can't change under the
+  // consumer's feet, so it is left to the consumer to apply the new size when
+  // its tail wraps around (see ApplyPendingSize()):
+  if (LOAD_ACQUIRE(pendingSize))
+     return; // the consumer hasn't wrapped around yet
+  int Size = this->Size();
+  bool Wrapped = Tail > head;
+  int Fill = (Wrapped ? Size - Tail + head - margin : head - Tail) + Count;
+  if (Fill > Size / 100 * RBGROWTHRESHOLD) {
+     lowFillSince = 0;
+     if (Size < maxSize) {
+        int Bytes = min(Size, maxSize - Size); // doubles the size if possible
+        if (budget)
+           Bytes = budget->Acquire(Bytes);
+        int Grow = Bytes / RBGROWSTEP * RBGROWSTEP;
+        if (budget && Bytes > Grow)
+           budget->Release(Bytes - Grow);
+        if (Grow > 0) {
+           if (Wrapped)
+              STORE_RELEASE(pendingSize, Size + Grow);
+           else
+              SetSize(Size + Grow);
+           GrownBytes.Add(Grow);
+           dsyslog("%s buffer grown to %d KB", description ? description : "ring", (Size + Grow) / KILOBYTE(1));
+           }
+        }
+     }
+  else if (Wrapped)
+     return; // shrinking has to wait until the data doesn't wrap around
+  else if (Fill < Size / 100 * RBSHRINKTHRESHOLD && Size > initialSize) {
+     time_t Now = time(NULL);
+     if (!lowFillSince)
+        lowFillSince = Now;
+     else if (Now - lowFillSince >= RBSHRINKDELAY) {
+        int NewSize = max(Size / 2 / RBGROWSTEP * RBGROWSTEP, initialSize);
+        if (head < NewSize) { // otherwise we wait until the head has wrapped around
+           SetSize(NewSize);
+           if (madvise(buffer + NewSize, Size - NewSize, MADV_DONTNEED) < 0)
+              LOG_ERROR;
+           if (budget)
+              budget->Release(Size - NewSize);
+           GrownBytes.Add(NewSize - Size);
+           dsyslog("%s buffer shrunk to %d KB", description ? description : "ring", NewSize / KILOBYTE(1));
+           lowFillSince = Now;
+           }
+        }
+     }
+  else
+     lowFillSince = 0;
+}
+
+void cRingBufferLinear::ApplyPendingSize(void)
+{
+  // This is called by the consumer right before its tail wraps around. The
+  // producer only looks at the size after it has seen the new tail:
+  int NewSize = LOAD_ACQUIRE(pendingSize);
+  if (NewSize) {
+     SetSize(NewSize);
+     STORE_RELEASE(pendingSize, 0);
+     }
+}
+
 int cRingBufferLinear::DataReady(const uchar *Data, int Count)
 {
   return Count >= margin ? Count : 0;
@@ -194,13 +391,13 @@ int cRingBufferLinear::DataReady(const uchar *Data, int Count)
 
 int cRingBufferLinear::Available(void)
 {
-  int diff = head - tail;
+  int diff = LOAD_ACQUIRE(head) - LOAD_ACQUIRE(tail);
   return (diff >= 0) ? diff : Size() + diff - margin;
 }
 
 void cRingBufferLinear::Clear(void)
 {
-  tail = head;
+  STORE_RELEASE(tail, LOAD_ACQUIRE(head));
 #ifdef DEBUGRINGBUFFERS
   lastHead = head;
   lastTail = tail;
@@ -212,7 +409,7 @@ void cRingBufferLinear::Clear(void)
 
 int cRingBufferLinear::Read(int FileHandle, int Max)
 {
-  int Tail = tail;
+  int Tail = LOAD_ACQUIRE(tail);
   int diff = Tail - head;
   int free = (diff > 0) ? diff - 1 : Size() - head;
   if (Tail <= margin)
@@ -226,9 +423,9 @@ int cRingBufferLinear::Read(int FileHandle, int Max)
         int Head = head + Count;
         if (Head >= Size())
            Head = margin;
-        head = Head;
+        STORE_RELEASE(head, Head);
         if (statistics) {
-           int fill = head - Tail;
+           int fill = Head - Tail;
            if (fill < 0)
               fill = Size() + fill;
            else if (fill >= Size())
@@ -250,7 +447,9 @@ int cRingBufferLinear::Read(int FileHandle, int Max)
 int cRingBufferLinear::Put(const uchar *Data, int Count)
 {
   if (Count > 0) {
-     int Tail = tail;
+     int Tail = LOAD_ACQUIRE(tail);
+     if (maxSize)
+        Resize(Tail, Count);
      int rest = Size() - head;
      int diff = Tail - head;
      int free = ((Tail < margin) ? rest : (diff > 0) ? diff : Size() + diff - margin) - 1;
@@ -267,11 +466,11 @@ int cRingBufferLinear::Put(const uchar *Data, int Count)
            memcpy(buffer + head, Data, rest);
            if (Count - rest)
               memcpy(buffer + margin, Data + rest, Count - rest);
-           head = margin + Count - rest;
+           STORE_RELEASE(head, margin + Count - rest);
            }
         else {
            memcpy(buffer + head, Data, Count);
-           head += Count;
+           STORE_RELEASE(head, head + Count);
            }
         }
      else
@@ -289,14 +488,16 @@ int cRingBufferLinear::Put(const uchar *Data, int Count)
 
 uchar *cRingBufferLinear::Get(int &Count)
 {
-  int Head = head;
+  int Head = LOAD_ACQUIRE(head);
   if (getThreadTid <= 0)
      getThreadTid = cThread::ThreadId();
   int rest = Size() - tail;
   if (rest < margin && Head < tail) {
      int t = margin - rest;
      memcpy(buffer + t, buffer + tail, rest);
-     tail = t;
+     if (maxSize)
+        ApplyPendingSize();
+     STORE_RELEASE(tail, t);
      rest = Head - tail;
      }
   int diff = Head - tail;
@@ -322,9 +523,12 @@ void cRingBufferLinear::Del(int Count)
      int Tail = tail;
      Tail += Count;
      gotten -= Count;
-     if (Tail >= Size())
+     if (Tail >= Size()) {
         Tail = margin;
-     tail = Tail;
+        if (maxSize)
+           ApplyPendingSize();
+        }
+     STORE_RELEASE(tail, Tail);
      EnablePut();
      }
 #ifdef DEBUGRINGBUFFERS
@@ -350,11 +554,119 @@ cFrame::cFrame(const uchar *Data, int Count, eFrameType Type, int Index)
         esyslog("ERROR: can't allocate frame buffer (count=%d)", count);
      }
   next = NULL;
+  pool = NULL;
 }
 
 cFrame::~cFrame()
 {
-  free(data);
+  if (pool)
+     pool->Release(data);
+  else
+     free(data);
+}
+
+// --- cFramePool ------------------------------------------------------------
+
+#define FRAMEPOOLMINSIZE   KILOBYTE(4) // the size of the smallest buffer class
+#define FRAMEPOOLHEADER    16 // bytes in front of each buffer, holding its class
+
+cFramePool::cFramePool(int MaxCached)
+{
+  frames = NULL;
+  memset(buffers, 0, sizeof(buffers));
+  cached = 0;
+  maxCached = MaxCached;
+}
+
+cFramePool::~cFramePool()
+{
+  while (frames) {
+        cFrame *f = frames;
+        frames = f->next;
+        f->pool = NULL;
+        delete f;
+        }
+  for (int c = 0; c < FRAMEPOOLCLASSES; c++) {
+      while (buffers[c]) {
+            uchar *b = buffers[c];
+            buffers[c] = *(uchar **)b;
+            free(b - FRAMEPOOLHEADER);
+            }
+      }
+}
+
+uchar *cFramePool::Allocate(int Size)
+{
+  int c = 0;
+  while (c < FRAMEPOOLCLASSES - 1 && (FRAMEPOOLMINSIZE << c) < Size)
+        c++;
+  int ClassSize = FRAMEPOOLMINSIZE << c;
+  if (ClassSize < Size) {
+     esyslog("ERROR: frame too large for pool (%d > %d)", Size, ClassSize);
+     return NULL;
+     }
+  mutex.Lock();
+  uchar *b = buffers[c];
+  if (b) {
+     buffers[c] = *(uchar **)b;
+     cached -= ClassSize;
+     }
+  mutex.Unlock();
+  if (!b) {
+     uchar *p = MALLOC(uchar, FRAMEPOOLHEADER + ClassSize);
+     if (!p) {
+        esyslog("ERROR: can't allocate frame buffer (size=%d)", ClassSize);
+        return NULL;
+        }
+     *(int *)p = c;
+     b = p + FRAMEPOOLHEADER;
+     }
+  return b;
+}
+
+void cFramePool::Release(uchar *Buffer)
+{
+  if (Buffer) {
+     int c = *(int *)(Buffer - FRAMEPOOLHEADER);
+     int ClassSize = FRAMEPOOLMINSIZE << c;
+     cMutexLock MutexLock(&mutex);
+     if (cached + ClassSize <= maxCached) {
+        *(uchar **)Buffer = buffers[c];
+        buffers[c] = Buffer;
+        cached += ClassSize;
+        }
+     else
+        free(Buffer - FRAMEPOOLHEADER);
+     }
+}
+
+cFrame *cFramePool::NewFrame(uchar *Data, int Count, eFrameType Type, int Index)
+{
+  mutex.Lock();
+  cFrame *f = frames;
+  if (f)
+     frames = f->next;
+  mutex.Unlock();
+  if (f) {
+     f->data = Data;
+     f->count = Count;
+     f->type = Type;
+     f->index = Index;
+     f->next = NULL;
+     }
+  else
+     f = new cFrame(Data, -Count, Type, Index);
+  f->pool = this;
+  return f;
+}
+
+void cFramePool::Recycle(cFrame *Frame)
+{
+  Release(Frame->data);
+  Frame->data = NULL;
+  cMutexLock MutexLock(&mutex);
+  Frame->next = frames;
+  frames = Frame;
 }
 
 // --- cRingBufferFrame ------------------------------------------------------
@@ -413,7 +725,10 @@ cFrame *cRingBufferFrame::Get(void)
 void cRingBufferFrame::Delete(cFrame *Frame)
 {
   currentFill -= Frame->Count();
-  delete Frame;
+  if (Frame->pool)
+     Frame->pool->Recycle(Frame);
+  else
+     delete Frame;
 }
 
 void cRingBufferFrame::Drop(cFrame *Frame)
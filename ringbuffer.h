@@ -18,6 +18,8 @@ private:
   cCondWait readyForPut, readyForGet;
   int putTimeout;
   int getTimeout;
+  bool singleProducerConsumer;
+  volatile int waitingForPut, waitingForGet;
   int size;
   time_t lastOverflowReport;
   int overflowCount;
@@ -36,13 +38,41 @@ protected:
   virtual int Available(void) = 0;
   virtual int Free(void) { return Size() - Available() - 1; }
   int Size(void) { return size; }
+  void SetSize(int Size) { size = Size; }
 public:
   cRingBuffer(int Size, bool Statistics = false);
   virtual ~cRingBuffer();
   void SetTimeouts(int PutTimeout, int GetTimeout);
+  void SetSingleProducerConsumer(bool On = true);
+    ///< Tells the ring buffer that it is only ever filled by one thread and
+    ///< emptied by one other thread. In this mode the condition variables
+    ///< are only signalled if the other side is actually waiting, so that
+    ///< a producer that keeps putting small chunks of data doesn't cause a
+    ///< wakeup (and the associated mutex/futex traffic) with every call.
   void ReportOverflow(int Bytes);
   };
 
+/// A cRingBufferBudget limits the total amount of memory by which a number
+/// of growable ring buffers may exceed their initial sizes.
+
+class cRingBufferBudget {
+private:
+  cMutex mutex;
+  int limit;
+  int used;
+public:
+  cRingBufferBudget(int Limit = 0);
+  void SetLimit(int Limit);
+    ///< Sets the number of bytes in this budget. Bytes already in use are not
+    ///< affected if Limit is lower than that.
+  int Acquire(int Bytes);
+    ///< Takes at most Bytes from this budget.
+    ///< \return Returns the number of bytes actually taken.
+  void Release(int Bytes);
+    ///< Gives Bytes that have been taken by Acquire() back to this budget.
+  int Used(void) { return used; }
+  };
+
 class cRingBufferLinear : public cRingBuffer {
 //#define DEBUGRINGBUFFERS
 #ifdef DEBUGRINGBUFFERS
@@ -60,6 +90,13 @@ private:
   int gotten;
   uchar *buffer;
   char *description;
+  int initialSize;
+  int maxSize;
+  int pendingSize; // the size the consumer shall apply when its tail wraps around (0 = none)
+  cRingBufferBudget *budget;
+  time_t lowFillSince;
+  void Resize(int Tail, int Count);
+  void ApplyPendingSize(void);
 protected:
   virtual int DataReady(const uchar *Data, int Count);
     ///< By default a ring buffer has data ready as soon as there are at least
@@ -68,12 +105,26 @@ protected:
     ///< The return value is either 0 if there is not yet enough data available,
     ///< or the number of bytes from the beginning of Data that are "ready".
 public:
-  cRingBufferLinear(int Size, int Margin = 0, bool Statistics = false, const char *Description = NULL);
+  cRingBufferLinear(int Size, int Margin = 0, bool Statistics = false, const char *Description = NULL, int MaxSize = 0);
     ///< Creates a linear ring buffer.
     ///< The buffer will be able to hold at most Size-Margin-1 bytes of data, and will
     ///< be guaranteed to return at least Margin bytes in one consecutive block.
     ///< The optional Description is used for debugging only.
+    ///< If MaxSize is larger than Size, MaxSize bytes of address space are
+    ///< reserved, and Put() lets the buffer grow up to MaxSize when it is
+    ///< more than half full or overflows, and shrink back towards Size when
+    ///< it has been almost empty for a while. If the data wraps around the end
+    ///< of the buffer, the new size only takes effect once the consumer has
+    ///< wrapped around, too. Memory beyond the current size
+    ///< is given back to the system, so only the memory actually needed
+    ///< counts against the resident size of the process.
+    ///< Head and tail are published with acquire/release semantics, so one
+    ///< producer thread (Read(), Put()) and one consumer thread (Get(), Del(),
+    ///< Clear()) can access the buffer without any further locking.
   virtual ~cRingBufferLinear();
+  void SetBudget(cRingBufferBudget *Budget) { budget = Budget; }
+    ///< Makes this buffer take the memory it needs for growing beyond its
+    ///< initial size from Budget. Must be called before the first Put().
   virtual int Available(void);
   virtual int Free(void) { return Size() - Available() - 1 - margin; }
   virtual void Clear(void);
@@ -100,14 +151,18 @@ public:
 
 enum eFrameType { ftUnknown, ftVideo, ftAudio, ftDolby };
 
+class cFramePool;
+
 class cFrame {
   friend class cRingBufferFrame;
+  friend class cFramePool;
 private:
   cFrame *next;
   uchar *data;
   int count;
   eFrameType type;
   int index;
+  cFramePool *pool;
 public:
   cFrame(const uchar *Data, int Count, eFrameType = ftUnknown, int Index = -1);
     ///< Creates a new cFrame object.
@@ -120,6 +175,34 @@ public:
   int Index(void) const { return index; }
   };
 
+#define FRAMEPOOLCLASSES 8 // number of buffer size classes (4KB...512KB)
+
+class cFramePool {
+private:
+  cMutex mutex;
+  cFrame *frames;
+  uchar *buffers[FRAMEPOOLCLASSES];
+  int cached;
+  int maxCached;
+public:
+  cFramePool(int MaxCached);
+    ///< Creates a pool that recycles cFrame objects and their data buffers,
+    ///< instead of allocating and freeing them for every single frame.
+    ///< At most MaxCached bytes of unused buffers are kept in the pool.
+    ///< The pool must not be deleted before all of its frames and buffers.
+  ~cFramePool();
+  uchar *Allocate(int Size);
+    ///< Returns a buffer that can hold at least Size bytes. The buffer must be
+    ///< returned to the pool with Release(), or handed over to NewFrame().
+  void Release(uchar *Buffer);
+  cFrame *NewFrame(uchar *Data, int Count, eFrameType Type = ftUnknown, int Index = -1);
+    ///< Returns a frame that takes ownership of the given Data, which must
+    ///< have been obtained through Allocate(). Deleting the frame returns
+    ///< Data to the pool, and cRingBufferFrame::Drop() also recycles the
+    ///< cFrame object itself.
+  void Recycle(cFrame *Frame);
+  };
+
 class cRingBufferFrame : public cRingBuffer {
 private:
   cMutex mutex;
@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include "channels.h"
 #include "device.h"
+#include "metrics.h"
 #include "thread.h"
 
 // --- cFilterHandle----------------------------------------------------------
@@ -39,6 +40,9 @@ public:
 
 // --- cSectionHandler -------------------------------------------------------
 
+static cMetricCounter Sections("sections.received");
+static cMetricCounter IncompleteSections("sections.incomplete");
+
 cSectionHandler::cSectionHandler(cDevice *Device)
 :cThread("section handler")
 {
@@ -204,6 +208,7 @@ void cSectionHandler::Action(void)
                      if (r > 3) { // minimum number of bytes necessary to get section length
                         int len = (((buf[1] & 0x0F) << 8) | (buf[2] & 0xFF)) + 3;
                         if (len == r) {
+                           Sections.Add();
                            // Distribute data to all attached filters:
                            int pid = fh->filterData.pid;
                            int tid = buf[0];
@@ -212,9 +217,12 @@ void cSectionHandler::Action(void)
                                   fi->Process(pid, tid, buf, len);
                                }
                            }
-                        else if (time(NULL) - lastIncompleteSection > 10) { // log them only every 10 seconds
-                           dsyslog("read incomplete section - len = %d, r = %d", len, r);
-                           lastIncompleteSection = time(NULL);
+                        else {
+                           IncompleteSections.Add();
+                           if (time(NULL) - lastIncompleteSection > 10) { // log them only every 10 seconds
+                              dsyslog("read incomplete section - len = %d, r = %d", len, r);
+                              lastIncompleteSection = time(NULL);
+                              }
                            }
                         }
                      }
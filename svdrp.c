@@ -33,6 +33,7 @@
 #include "eitscan.h"
 #include "keys.h"
 #include "menu.h"
+#include "metrics.h"
 #include "plugin.h"
 #include "remote.h"
 #include "skins.h"
@@ -240,6 +241,14 @@ const char *HelpPages[] = {
   "MESG <message>\n"
   "    Displays the given message on the OSD. The message will be queued\n"
   "    and displayed whenever this is suitable.\n",
+  "METR [ <name> ]\n"
+  "    List the metrics of the recording and receiving paths (packets per\n"
+  "    device, remux and writer throughput, ring buffer fill levels and\n"
+  "    overflows, section and EPG rates). Counters have one value, while\n"
+  "    histograms show count, sum, average and 50/90/99 percentiles (as the\n"
+  "    upper limits of power-of-two buckets). All values are cumulative since\n"
+  "    VDR was started. If a <name> is given, only the metrics whose names\n"
+  "    begin with it are listed.",
   "MODC <number> <settings>\n"
   "    Modify a channel. Settings must be in the same format as returned\n"
   "    by the LSTC command.",
@@ -299,8 +308,10 @@ const char *HelpPages[] = {
   "SCAN\n"
   "    Forces an EPG scan. If this is a single DVB device system, the scan\n"
   "    will be done on the primary device unless it is currently recording.",
-  "STAT disk\n"
-  "    Return information about disk usage (total, free, percent).",
+  "STAT disk | writer\n"
+  "    Return information about disk usage (total, free, percent), or about\n"
+  "    the write behind buffers of all files that are currently being recorded\n"
+  "    (buffer fill level, write latency and amount of data written).",
   "UPDT <settings>\n"
   "    Updates a timer. Settings must be in the same format as returned\n"
   "    by the LSTT command. If a timer with the same channel, day, start\n"
@@ -950,85 +961,88 @@ void cSVDRP::CmdLSTC(const char *Option)
 
 void cSVDRP::CmdLSTE(const char *Option)
 {
-  cSchedulesLock SchedulesLock;
-  const cSchedules *Schedules = cSchedules::Schedules(SchedulesLock);
-  if (Schedules) {
-     const cSchedule* Schedule = NULL;
-     eDumpMode DumpMode = dmAll;
-     time_t AtTime = 0;
-     if (*Option) {
-        char buf[strlen(Option) + 1];
-        strcpy(buf, Option);
-        const char *delim = " \t";
-        char *strtok_next;
-        char *p = strtok_r(buf, delim, &strtok_next);
-        while (p && DumpMode == dmAll) {
-              if (strcasecmp(p, "NOW") == 0)
-                 DumpMode = dmPresent;
-              else if (strcasecmp(p, "NEXT") == 0)
-                 DumpMode = dmFollowing;
-              else if (strcasecmp(p, "AT") == 0) {
-                 DumpMode = dmAtTime;
-                 if ((p = strtok_r(NULL, delim, &strtok_next)) != NULL) {
-                    if (isnumber(p))
-                       AtTime = strtol(p, NULL, 10);
-                    else {
-                       Reply(501, "Invalid time");
-                       return;
-                       }
-                    }
-                 else {
-                    Reply(501, "Missing time");
-                    return;
-                    }
-                 }
-              else if (!Schedule) {
-                 cChannel* Channel = NULL;
-                 if (isnumber(p))
-                    Channel = Channels.GetByNumber(strtol(Option, NULL, 10));
-                 else
-                    Channel = Channels.GetByChannelID(tChannelID::FromString(Option));
-                 if (Channel) {
-                    Schedule = Schedules->GetSchedule(Channel);
-                    if (!Schedule) {
-                       Reply(550, "No schedule found");
-                       return;
-                       }
-                    }
-                 else {
-                    Reply(550, "Channel \"%s\" not defined", p);
-                    return;
-                    }
-                 }
-              else {
-                 Reply(501, "Unknown option: \"%s\"", p);
-                 return;
-                 }
-              p = strtok_r(NULL, delim, &strtok_next);
-              }
-        }
-     int fd = dup(file);
-     if (fd) {
-        FILE *f = fdopen(fd, "w");
-        if (f) {
-           if (Schedule)
-              Schedule->Dump(f, "215-", DumpMode, AtTime);
-           else
-              Schedules->Dump(f, "215-", DumpMode, AtTime);
-           fflush(f);
+  const cSchedule* Schedule = NULL;
+  eDumpMode DumpMode = dmAll;
+  time_t AtTime = 0;
+  {
+    cSchedulesLock SchedulesLock;
+    const cSchedules *Schedules = cSchedules::Schedules(SchedulesLock);
+    if (!Schedules) {
+       Reply(451, "Can't get EPG data");
+       return;
+       }
+    if (*Option) {
+       char buf[strlen(Option) + 1];
+       strcpy(buf, Option);
+       const char *delim = " \t";
+       char *strtok_next;
+       char *p = strtok_r(buf, delim, &strtok_next);
+       while (p && DumpMode == dmAll) {
+             if (strcasecmp(p, "NOW") == 0)
+                DumpMode = dmPresent;
+             else if (strcasecmp(p, "NEXT") == 0)
+                DumpMode = dmFollowing;
+             else if (strcasecmp(p, "AT") == 0) {
+                DumpMode = dmAtTime;
+                if ((p = strtok_r(NULL, delim, &strtok_next)) != NULL) {
+                   if (isnumber(p))
+                      AtTime = strtol(p, NULL, 10);
+                   else {
+                      Reply(501, "Invalid time");
+                      return;
+                      }
+                   }
+                else {
+                   Reply(501, "Missing time");
+                   return;
+                   }
+                }
+             else if (!Schedule) {
+                cChannel* Channel = NULL;
+                if (isnumber(p))
+                   Channel = Channels.GetByNumber(strtol(Option, NULL, 10));
+                else
+                   Channel = Channels.GetByChannelID(tChannelID::FromString(Option));
+                if (Channel) {
+                   Schedule = Schedules->GetSchedule(Channel);
+                   if (!Schedule) {
+                      Reply(550, "No schedule found");
+                      return;
+                      }
+                   }
+                else {
+                   Reply(550, "Channel \"%s\" not defined", p);
+                   return;
+                   }
+                }
+             else {
+                Reply(501, "Unknown option: \"%s\"", p);
+                return;
+                }
+             p = strtok_r(NULL, delim, &strtok_next);
+             }
+       }
+  }
+  // The EPG data is sent without holding the lock (see cSchedules::Dump()):
+  int fd = dup(file);
+  if (fd) {
+     FILE *f = fdopen(fd, "w");
+     if (f) {
+        bool Ok = cSchedules::Dump(f, "215-", DumpMode, AtTime, Schedule);
+        fflush(f);
+        if (Ok)
            Reply(215, "End of EPG data");
-           fclose(f);
-           }
-        else {
-           Reply(451, "Can't open file connection");
-           close(fd);
-           }
+        else
+           Reply(451, "Can't get EPG data");
+        fclose(f);
+        }
+     else {
+        Reply(451, "Can't open file connection");
+        close(fd);
         }
-     else
-        Reply(451, "Can't dup stream descriptor");
      }
   else
-     Reply(451, "Can't get EPG data");
+     Reply(451, "Can't dup stream descriptor");
 }
 
 void cSVDRP::CmdLSTR(const char *Option)
@@ -1118,6 +1132,17 @@ void cSVDRP::CmdMESG(const char *Option)
      Reply(501, "Missing message");
 }
 
+void cSVDRP::CmdMETR(const char *Option)
+{
+  cStringList Lines;
+  if (cMetrics::List(Lines, *Option ? Option : NULL)) {
+     for (int i = 0; i < Lines.Size(); i++)
+         Reply(i < Lines.Size() - 1 ? -250 : 250, "%s", Lines[i]);
+     }
+  else
+     Reply(550, "No metrics found");
+}
+
 void cSVDRP::CmdMODC(const char *Option)
 {
   if (*Option) {
@@ -1480,6 +1505,15 @@ void cSVDRP::CmdSTAT(const char *Option)
         int Percent = VideoDiskSpace(&FreeMB, &UsedMB);
         Reply(250, "%dMB %dMB %d%%", FreeMB + UsedMB, FreeMB, Percent);
         }
+     else if (strcasecmp(Option, "WRITER") == 0) {
+        cStringList Lines;
+        if (cUnbufferedFile::WriteBehindStatus(Lines)) {
+           for (int i = 0; i < Lines.Size(); i++)
+               Reply(i < Lines.Size() - 1 ? -250 : 250, "%s", Lines[i]);
+           }
+        else
+           Reply(550, "No files are being written");
+        }
      else
         Reply(501, "Invalid Option \"%s\"", Option);
      }
@@ -1576,6 +1610,7 @@ void cSVDRP::Execute(char *Cmd)
   else if (CMD("LSTR"))  CmdLSTR(s);
   else if (CMD("LSTT"))  CmdLSTT(s);
   else if (CMD("MESG"))  CmdMESG(s);
+  else if (CMD("METR"))  CmdMETR(s);
   else if (CMD("MODC"))  CmdMODC(s);
   else if (CMD("MODT"))  CmdMODT(s);
   else if (CMD("MOVC"))  CmdMOVC(s);
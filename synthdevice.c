@@ -0,0 +1,737 @@
+/*
+ * synthdevice.c: A synthetic device for load testing
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#include "synthdevice.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include "channels.h"
+#include "recording.h"
+
+#define SYNTHMAXSIZE     64 // MB, the maximum amount of a TS file that is replayed
+#define SYNTHGENSECONDS  10 // length of the generated multiplex
+#define SYNTHGENBITRATE  6000000 // video bit rate of the generated multiplex
+#define SYNTHDEFAULTRATE 8000000 // bit/s, if a TS file has no PCRs
+#define SYNTHCHUNK       256 // TS packets read from the stream at once
+#define SYNTHBUFSIZE     (4 * SYNTHCHUNK * TS_SIZE)
+#define SYNTHMAXLAG      1000 // ms the replay may fall behind before data is skipped
+
+// --- cSynthStream ----------------------------------------------------------
+
+#define SYNTHVPID  0x0100
+#define SYNTHAPID  0x0101
+#define SYNTHDPID  0x0102
+
+cSynthStream::cSynthStream(const char *Name)
+{
+  name = strdup(Name);
+  data = NULL;
+  size = length = 0;
+  duration = 0;
+  seed = 1;
+  memset(counter, 0, sizeof(counter));
+  vpid = 0;
+  memset(apids, 0, sizeof(apids));
+  memset(dpids, 0, sizeof(dpids));
+}
+
+cSynthStream::~cSynthStream()
+{
+  free(data);
+  free(name);
+}
+
+void cSynthStream::PutPes(int Pid, const uchar *Pes, int Length)
+{
+  int &Counter = counter[Pid & 0x03];
+  bool First = true;
+  while (Length > 0) {
+        if (length + TS_SIZE > size) {
+           size = size ? size * 2 : MEGABYTE(16);
+           data = (uchar *)realloc(data, size);
+           }
+        uchar *p = data + length;
+        p[0] = TS_SYNC_BYTE;
+        p[1] = (First ? 0x40 : 0x00) | (Pid >> 8);
+        p[2] = Pid;
+        int n = TS_SIZE - 4;
+        if (Length < n) {
+           // the last packet is filled up with an adaptation field:
+           int Stuffing = n - Length;
+           p[3] = 0x30 | (Counter++ & 0x0F);
+           p[4] = Stuffing - 1;
+           if (Stuffing > 1) {
+              p[5] = 0x00;
+              memset(p + 6, 0xFF, Stuffing - 2);
+              }
+           n = Length;
+           }
+        else
+           p[3] = 0x10 | (Counter++ & 0x0F);
+        memcpy(p + TS_SIZE - n, Pes, n);
+        Pes += n;
+        Length -= n;
+        length += TS_SIZE;
+        First = false;
+        }
+}
+
+void cSynthStream::PutVideoFrame(int Frame, int Length)
+{
+  static const uchar PictureTypes[] = { I_FRAME, B_FRAME, B_FRAME, P_FRAME, B_FRAME, B_FRAME, P_FRAME, B_FRAME, B_FRAME, P_FRAME, B_FRAME, B_FRAME };
+  uchar PictureType = PictureTypes[Frame % sizeof(PictureTypes)];
+  uchar *Pes = MALLOC(uchar, Length + 64);
+  uchar *p = Pes;
+  // PES header, with a length of 0 as broadcasters use it for video:
+  *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = 0xE0;
+  *p++ = 0x00; *p++ = 0x00;
+  *p++ = 0x80; *p++ = 0x00; *p++ = 0x00;
+  if (PictureType == I_FRAME) {
+     // sequence header (720x576, 25 fps) and GOP header:
+     *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = 0xB3;
+     *p++ = 0x2D; *p++ = 0x02; *p++ = 0x40; *p++ = 0x33;
+     *p++ = 0xFF; *p++ = 0xFF; *p++ = 0xE0; *p++ = 0x18;
+     *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = 0xB8;
+     *p++ = 0x00; *p++ = 0x08; *p++ = 0x00; *p++ = 0x00;
+     }
+  // picture header:
+  *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = 0x00;
+  *p++ = (Frame >> 2) & 0xFF; *p++ = ((Frame & 0x03) << 6) | (PictureType << 3); *p++ = 0xFF; *p++ = 0xF8;
+  // slices with random data that contains no start codes:
+  uchar *Limit = Pes + Length;
+  for (int Slice = 1; p < Limit; Slice++) {
+      *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = min(Slice, 0xAF);
+      for (int i = 0; i < 2000 && p < Limit; i++)
+          *p++ = (rand_r(&seed) % 0xFE) + 1;
+      }
+  PutPes(vpid, Pes, p - Pes);
+  free(Pes);
+}
+
+void cSynthStream::PutAudioPacket(int Pid, int FrameSize, int Frames)
+{
+  int Length = 9 + Frames * FrameSize;
+  uchar *Pes = MALLOC(uchar, Length);
+  uchar *p = Pes;
+  *p++ = 0x00; *p++ = 0x00; *p++ = 0x01; *p++ = Pid == SYNTHDPID ? 0xBD : 0xC0;
+  *p++ = (Length - 6) >> 8; *p++ = Length - 6;
+  *p++ = 0x80; *p++ = 0x00; *p++ = 0x00;
+  for (int f = 0; f < Frames; f++) {
+      uchar *Frame = p;
+      for (int i = 0; i < FrameSize; i++)
+          *p++ = rand_r(&seed);
+      if (Pid == SYNTHDPID) {
+         // AC3 sync frame, 48 kHz, 448 kbit/s:
+         Frame[0] = 0x0B; Frame[1] = 0x77; Frame[4] = 0x1E; Frame[5] = 0x40;
+         }
+      else {
+         // MPEG-1 layer II frame, 48 kHz, 192 kbit/s:
+         Frame[0] = 0xFF; Frame[1] = 0xFD; Frame[2] = 0xA4; Frame[3] = 0x04;
+         }
+      }
+  PutPes(Pid, Pes, Length);
+  free(Pes);
+}
+
+bool cSynthStream::Generate(int Seconds, int VideoBitRate, bool Mpeg, bool Ac3)
+{
+  seed = 1; // all runs shall see the same data
+  vpid = VideoBitRate ? SYNTHVPID : 0;
+  apids[0] = Mpeg ? SYNTHAPID : 0;
+  apids[1] = 0;
+  dpids[0] = Ac3 ? SYNTHDPID : 0;
+  dpids[1] = 0;
+  // Audio is sent in packets of two MPEG frames (2 * 24 ms) and one AC3 frame (32 ms):
+  int AudioTime = 0, Ac3Time = 0;
+  for (int Frame = 0; Frame < Seconds * FRAMESPERSEC; Frame++) {
+      int VideoTime = Frame * 1000 / FRAMESPERSEC;
+      if (vpid) {
+         int Average = VideoBitRate / 8 / FRAMESPERSEC;
+         int Length = (Frame % 12 == 0) ? 3 * Average : Average / 2 + rand_r(&seed) % Average;
+         PutVideoFrame(Frame, Length);
+         }
+      for (; Mpeg && AudioTime <= VideoTime; AudioTime += 48)
+          PutAudioPacket(SYNTHAPID, 576, 2);
+      for (; Ac3 && Ac3Time <= VideoTime; Ac3Time += 32)
+          PutAudioPacket(SYNTHDPID, 1792, 1);
+      }
+  duration = Seconds * 1000;
+  return length > 0;
+}
+
+bool cSynthStream::Load(const char *FileName, int MaxMB)
+{
+  int f = open(FileName, O_RDONLY);
+  if (f < 0) {
+     LOG_ERROR_STR(FileName);
+     return false;
+     }
+  size = MEGABYTE(MaxMB);
+  data = MALLOC(uchar, size);
+  length = 0;
+  int r;
+  while (length < size && (r = safe_read(f, data + length, size - length)) > 0)
+        length += r;
+  close(f);
+  length -= length % TS_SIZE;
+  // The playing time is derived from the PCRs of the first PID that carries any:
+  int PcrPid = -1;
+  int FirstOffset = 0, LastOffset = 0;
+  int64_t FirstPcr = 0, LastPcr = 0;
+  for (int i = 0; i < length; i += TS_SIZE) {
+      const uchar *p = data + i;
+      if ((p[3] & 0x20) && p[4] >= 7 && (p[5] & 0x10) && (PcrPid < 0 || TsPid(p) == PcrPid)) {
+         int64_t Pcr = (int64_t(p[6]) << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+         if (PcrPid < 0) {
+            PcrPid = TsPid(p);
+            FirstOffset = i;
+            FirstPcr = Pcr;
+            }
+         LastOffset = i;
+         LastPcr = Pcr;
+         }
+      }
+  if (LastPcr > FirstPcr && LastOffset > FirstOffset)
+     duration = int((LastPcr - FirstPcr) / 90 * length / (LastOffset - FirstOffset));
+  cPatPmtParser PatPmtParser;
+  for (int i = 0; i < length; i += MEGABYTE(1)) {
+      if (PatPmtParser.Parse(data + i, min(MEGABYTE(1), length - i))) {
+         vpid = PatPmtParser.Vpid();
+         memcpy(apids, PatPmtParser.Apids(), sizeof(apids));
+         memcpy(dpids, PatPmtParser.Dpids(), sizeof(dpids));
+         return true;
+         }
+      }
+  esyslog("ERROR: no PAT/PMT found in %s", FileName);
+  return false;
+}
+
+// --- cSynthFilter ----------------------------------------------------------
+
+class cSynthFilter : public cListObject {
+private:
+  u_short pid;
+  u_char tid;
+  u_char mask;
+  int handle[2]; // [0] is read by the section handler, [1] is written to
+  uchar buffer[4096]; // max. allowed size for any section
+  int length; // -1 = not in sync
+  int sectionLength;
+  int counter;
+  void Store(const uchar *Data, int Count);
+public:
+  cSynthFilter(u_short Pid, u_char Tid, u_char Mask);
+  virtual ~cSynthFilter();
+  int Handle(void) { return handle[0]; }
+  void Put(const uchar *Data);
+       ///< Assembles sections from the given TS packet and delivers those that
+       ///< match this filter.
+  };
+
+cSynthFilter::cSynthFilter(u_short Pid, u_char Tid, u_char Mask)
+{
+  pid = Pid;
+  tid = Tid;
+  mask = Mask;
+  length = -1;
+  sectionLength = 0;
+  counter = -1;
+  // A sequenced packet socket keeps the sections apart, just like a demux device does:
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, handle) == 0) {
+     fcntl(handle[0], F_SETFL, fcntl(handle[0], F_GETFL) | O_NONBLOCK);
+     fcntl(handle[1], F_SETFL, fcntl(handle[1], F_GETFL) | O_NONBLOCK);
+     }
+  else {
+     LOG_ERROR;
+     handle[0] = handle[1] = -1;
+     }
+}
+
+cSynthFilter::~cSynthFilter()
+{
+  if (handle[0] >= 0) {
+     close(handle[0]);
+     close(handle[1]);
+     }
+}
+
+void cSynthFilter::Store(const uchar *Data, int Count)
+{
+  while (Count > 0 && length >= 0) {
+        int n = min((length < 3 ? 3 : sectionLength) - length, Count);
+        memcpy(buffer + length, Data, n);
+        length += n;
+        Data += n;
+        Count -= n;
+        if (length == 3) {
+           sectionLength = (((buffer[1] & 0x0F) << 8) | buffer[2]) + 3;
+           if (buffer[0] == 0xFF || sectionLength <= 3 || sectionLength > int(sizeof(buffer)))
+              length = -1; // stuffing or garbage
+           }
+        else if (length == sectionLength) {
+           if ((buffer[0] & mask) == (tid & mask))
+              send(handle[1], buffer, length, MSG_DONTWAIT); // if the socket is full, the section is lost, as with a real demux
+           length = 0;
+           }
+        }
+}
+
+void cSynthFilter::Put(const uchar *Data)
+{
+  if (TsPid(Data) != pid || !TsHasPayload(Data) || handle[0] < 0)
+     return;
+  int Counter = Data[3] & 0x0F;
+  if (Counter != ((counter + 1) & 0x0F))
+     length = -1; // a packet has been lost
+  counter = Counter;
+  int Offset = TsPayloadOffset(Data);
+  if (Offset >= TS_SIZE)
+     return;
+  const uchar *p = Data + Offset;
+  int Count = TS_SIZE - Offset;
+  if (TsPayloadStart(Data)) {
+     int Pointer = *p++;
+     Count--;
+     if (Pointer > Count) {
+        length = -1;
+        return;
+        }
+     Store(p, Pointer); // the rest of the previous section
+     p += Pointer;
+     Count -= Pointer;
+     length = 0;
+     }
+  Store(p, Count);
+}
+
+// --- cSynthTuner -----------------------------------------------------------
+
+#define MAXSYNTHPIDS MAXPIDHANDLES
+
+class cSynthTuner : public cThread {
+private:
+  cSynthStream *stream;
+  int cardIndex;
+  double speed;
+  int lossLimit;
+  unsigned int seed;
+  int fd_dvr[2];
+  bool dvrOpen;
+  bool tuned;
+  int source;
+  int transponder;
+  int sourcePids[MAXSYNTHPIDS];
+  int targetPids[MAXSYNTHPIDS];
+  int numPids;
+  bool activePids[0x2000];
+  cList<cSynthFilter> filters;
+  time_t lastOverflowReport;
+  cMutex mutex;
+  cMutex dvrMutex;
+  void MapPid(int SourcePid, int TargetPid);
+  void Write(const uchar *Data, int Length);
+  virtual void Action(void);
+public:
+  cSynthTuner(cSynthStream *Stream, int CardIndex, double Speed, double Loss);
+  virtual ~cSynthTuner();
+  bool IsTunedTo(const cChannel *Channel);
+  void Set(const cChannel *Channel);
+  void SetPids(const bool *ActivePids);
+  int OpenDvr(void);
+  void CloseDvr(void);
+  int OpenFilter(u_short Pid, u_char Tid, u_char Mask);
+  bool CloseFilter(int Handle);
+  };
+
+cSynthTuner::cSynthTuner(cSynthStream *Stream, int CardIndex, double Speed, double Loss)
+{
+  stream = Stream;
+  cardIndex = CardIndex;
+  speed = Speed;
+  lossLimit = int(Loss / 100 * RAND_MAX);
+  seed = CardIndex;
+  dvrOpen = false;
+  tuned = false;
+  source = transponder = 0;
+  numPids = 0;
+  memset(activePids, 0, sizeof(activePids));
+  lastOverflowReport = 0;
+  if (pipe(fd_dvr) == 0) {
+     fcntl(fd_dvr[0], F_SETFL, fcntl(fd_dvr[0], F_GETFL) | O_NONBLOCK);
+     fcntl(fd_dvr[1], F_SETFL, fcntl(fd_dvr[1], F_GETFL) | O_NONBLOCK);
+     }
+  else {
+     LOG_ERROR;
+     fd_dvr[0] = fd_dvr[1] = -1;
+     }
+  SetDescription("synthetic tuner on device %d", cardIndex + 1);
+  Start();
+}
+
+cSynthTuner::~cSynthTuner()
+{
+  dvrOpen = false;
+  Cancel(3);
+  if (fd_dvr[0] >= 0) {
+     close(fd_dvr[0]);
+     close(fd_dvr[1]);
+     }
+  delete stream;
+}
+
+bool cSynthTuner::IsTunedTo(const cChannel *Channel)
+{
+  cMutexLock MutexLock(&mutex);
+  return tuned && source == Channel->Source() && transponder == Channel->Transponder();
+}
+
+static int NumPids(const int *Pids)
+{
+  int n = 0;
+  while (n < MAXTRACKS && Pids[n])
+        n++;
+  return n;
+}
+
+void cSynthTuner::MapPid(int SourcePid, int TargetPid)
+{
+  if (SourcePid && TargetPid && numPids < MAXSYNTHPIDS) {
+     for (int i = 0; i < numPids; i++) {
+         if (targetPids[i] == TargetPid)
+            return;
+         }
+     sourcePids[numPids] = SourcePid;
+     targetPids[numPids] = TargetPid;
+     numPids++;
+     }
+}
+
+void cSynthTuner::Set(const cChannel *Channel)
+{
+  cMutexLock MutexLock(&mutex);
+  if (!tuned || source != Channel->Source() || transponder != Channel->Transponder()) {
+     numPids = 0;
+     source = Channel->Source();
+     transponder = Channel->Transponder();
+     tuned = true;
+     }
+  // Every channel gets the stream's tracks, so that any number of channels
+  // can be received from the same "transponder". If the channel has more
+  // tracks than the stream, the stream's last track is used for the rest:
+  MapPid(stream->Vpid(), Channel->Vpid());
+  int NumApids = NumPids(stream->Apids());
+  for (int i = 0; NumApids && Channel->Apid(i); i++)
+      MapPid(stream->Apids()[min(i, NumApids - 1)], Channel->Apid(i));
+  int NumDpids = NumPids(stream->Dpids());
+  for (int i = 0; NumDpids && Channel->Dpid(i); i++)
+      MapPid(stream->Dpids()[min(i, NumDpids - 1)], Channel->Dpid(i));
+}
+
+void cSynthTuner::SetPids(const bool *ActivePids)
+{
+  cMutexLock MutexLock(&mutex);
+  memcpy(activePids, ActivePids, sizeof(activePids));
+}
+
+int cSynthTuner::OpenDvr(void)
+{
+  cMutexLock MutexLock(&dvrMutex);
+  // Drop anything that's left over from the previous session:
+  uchar buf[TS_SIZE * 16];
+  while (read(fd_dvr[0], buf, sizeof(buf)) > 0)
+        ;
+  dvrOpen = true;
+  return fd_dvr[0];
+}
+
+void cSynthTuner::CloseDvr(void)
+{
+  dvrOpen = false;
+  cMutexLock MutexLock(&dvrMutex); // makes sure Write() has noticed
+}
+
+int cSynthTuner::OpenFilter(u_short Pid, u_char Tid, u_char Mask)
+{
+  cMutexLock MutexLock(&mutex);
+  cSynthFilter *Filter = new cSynthFilter(Pid, Tid, Mask);
+  if (Filter->Handle() >= 0) {
+     filters.Add(Filter);
+     return Filter->Handle();
+     }
+  delete Filter;
+  return -1;
+}
+
+bool cSynthTuner::CloseFilter(int Handle)
+{
+  cMutexLock MutexLock(&mutex);
+  for (cSynthFilter *Filter = filters.First(); Filter; Filter = filters.Next(Filter)) {
+      if (Filter->Handle() == Handle) {
+         filters.Del(Filter);
+         return true;
+         }
+      }
+  return false;
+}
+
+void cSynthTuner::Write(const uchar *Data, int Length)
+{
+  cMutexLock MutexLock(&dvrMutex);
+  while (Length > 0 && dvrOpen && Running()) {
+        int r = write(fd_dvr[1], Data, Length);
+        if (r > 0) {
+           Data += r;
+           Length -= r;
+           }
+        else if (r < 0 && errno != EAGAIN) {
+           LOG_ERROR;
+           break;
+           }
+        else if (speed > 0 && Length % TS_SIZE == 0) {
+           // The receiver doesn't keep up with real time, so the data is lost,
+           // just like with a DVB driver:
+           if (time(NULL) - lastOverflowReport > 10) {
+              esyslog("ERROR: buffer overflow on device %d", cardIndex + 1);
+              lastOverflowReport = time(NULL);
+              }
+           break;
+           }
+        else {
+           cPoller Poller(fd_dvr[1], true);
+           Poller.Poll(100);
+           }
+        }
+}
+
+void cSynthTuner::Action(void)
+{
+  const uchar *Data = stream->Data();
+  int Length = stream->Length();
+  int Offset = 0;
+  double BytesPerMs = speed * (stream->Duration() ? double(Length) / stream->Duration() : SYNTHDEFAULTRATE / 8000.0);
+  uint64_t Sent = 0;
+  cTimeMs Time;
+  uchar *Buffer = MALLOC(uchar, SYNTHBUFSIZE);
+  if (!Buffer)
+     return;
+  while (Running()) {
+        if (!tuned) {
+           cCondWait::SleepMs(100);
+           continue;
+           }
+        int Count = SYNTHCHUNK;
+        if (speed > 0) {
+           uint64_t Due = uint64_t(Time.Elapsed() * BytesPerMs);
+           if (Due > Sent + uint64_t(SYNTHMAXLAG * BytesPerMs))
+              Sent = Due; // we have been suspended for too long, so let's not try to catch up
+           Count = min(Count, Due > Sent ? int((Due - Sent) / TS_SIZE) : 0);
+           if (Count <= 0) {
+              cCondWait::SleepMs(10);
+              continue;
+              }
+           }
+        else if (!dvrOpen)
+           cCondWait::SleepMs(10); // there's no receiver that would slow us down
+        int n = 0;
+        mutex.Lock();
+        for (int i = 0; i < Count && n + numPids * TS_SIZE <= SYNTHBUFSIZE; i++) {
+            const uchar *p = Data + Offset;
+            Offset += TS_SIZE;
+            if (Offset >= Length)
+               Offset = 0;
+            Sent += TS_SIZE;
+            if (lossLimit && rand_r(&seed) < lossLimit)
+               continue;
+            for (cSynthFilter *Filter = filters.First(); Filter; Filter = filters.Next(Filter))
+                Filter->Put(p);
+            if (dvrOpen) {
+               int Pid = TsPid(p);
+               for (int j = 0; j < numPids; j++) {
+                   if (sourcePids[j] == Pid && activePids[targetPids[j]]) {
+                      uchar *q = Buffer + n;
+                      memcpy(q, p, TS_SIZE);
+                      q[1] = (q[1] & 0xE0) | (targetPids[j] >> 8);
+                      q[2] = targetPids[j] & 0xFF;
+                      n += TS_SIZE;
+                      }
+                   }
+               }
+            }
+        mutex.Unlock();
+        if (n)
+           Write(Buffer, n);
+        }
+  free(Buffer);
+}
+
+// --- cSynthDevice ----------------------------------------------------------
+
+cStringList cSynthDevice::specs;
+
+cSynthDevice::cSynthDevice(cSynthStream *Stream, double Speed, double Loss)
+{
+  tsBuffer = NULL;
+  synthTuner = new cSynthTuner(Stream, CardIndex(), Speed, Loss);
+  StartSectionHandler();
+}
+
+cSynthDevice::~cSynthDevice()
+{
+  StopSectionHandler();
+  CloseDvr();
+  delete synthTuner;
+}
+
+bool cSynthDevice::SetSpec(const char *Spec)
+{
+  const char *p = strchr(Spec, ',');
+  if (p) {
+     char *t;
+     double Speed = strtod(p + 1, &t);
+     double Loss = 0;
+     if (*t == ',')
+        Loss = strtod(t + 1, &t);
+     if (*t || Speed < 0 || Loss < 0 || Loss > 100)
+        return false;
+     }
+  if (specs.Size() >= MAXSYNTHDEVICES)
+     return false;
+  specs.Append(strdup(Spec));
+  return true;
+}
+
+bool cSynthDevice::Initialize(void)
+{
+  int found = 0;
+  for (int i = 0; i < specs.Size(); i++) {
+      char *FileName = strdup(specs[i]);
+      double Speed = 1;
+      double Loss = 0;
+      char *p = strchr(FileName, ',');
+      if (p) {
+         *p++ = 0;
+         Speed = strtod(p, &p);
+         if (*p == ',')
+            Loss = strtod(p + 1, NULL);
+         }
+      cSynthStream *Stream = new cSynthStream(FileName);
+      bool Ok = (!*FileName || strcmp(FileName, "-") == 0) ? Stream->Generate(SYNTHGENSECONDS, SYNTHGENBITRATE, true, true) : Stream->Load(FileName, SYNTHMAXSIZE);
+      if (Ok) {
+         cSynthDevice *Device = new cSynthDevice(Stream, Speed, Loss);
+         isyslog("device %d is synthetic: %s (%.1f MB, %d ms), speed %g, loss %g%%", Device->CardIndex() + 1, Stream->Name(), double(Stream->Length()) / MEGABYTE(1), Stream->Duration(), Speed, Loss);
+         found++;
+         }
+      else {
+         esyslog("ERROR: can't set up synthetic device from '%s'", specs[i]);
+         delete Stream;
+         }
+      free(FileName);
+      }
+  return found > 0;
+}
+
+bool cSynthDevice::ProvidesSource(int Source) const
+{
+  return true;
+}
+
+bool cSynthDevice::ProvidesTransponder(const cChannel *Channel) const
+{
+  return true;
+}
+
+bool cSynthDevice::ProvidesChannel(const cChannel *Channel, int Priority, bool *NeedsDetachReceivers) const
+{
+  bool result = Priority < 0 || Priority > this->Priority();
+  bool needsDetachReceivers = false;
+  if (Priority >= 0 && Receiving(true)) {
+     if (synthTuner->IsTunedTo(Channel))
+        result = !IsPrimaryDevice() || Priority >= Setup.PrimaryLimit;
+     else
+        needsDetachReceivers = true;
+     }
+  if (NeedsDetachReceivers)
+     *NeedsDetachReceivers = needsDetachReceivers;
+  return result;
+}
+
+bool cSynthDevice::IsTunedToTransponder(const cChannel *Channel)
+{
+  return synthTuner->IsTunedTo(Channel);
+}
+
+bool cSynthDevice::SetChannelDevice(const cChannel *Channel, bool LiveView)
+{
+  synthTuner->Set(Channel);
+  return true;
+}
+
+bool cSynthDevice::HasLock(int TimeoutMs)
+{
+  return true;
+}
+
+bool cSynthDevice::SetPid(cPidHandle *Handle, int Type, bool On)
+{
+  bool ActivePids[0x2000];
+  memset(ActivePids, 0, sizeof(ActivePids));
+  for (int i = 0; i < MAXPIDHANDLES; i++) {
+      if (pidHandles[i].used)
+         ActivePids[pidHandles[i].pid & 0x1FFF] = true;
+      }
+  synthTuner->SetPids(ActivePids);
+  return true;
+}
+
+int cSynthDevice::OpenFilter(u_short Pid, u_char Tid, u_char Mask)
+{
+  return synthTuner->OpenFilter(Pid, Tid, Mask);
+}
+
+void cSynthDevice::CloseFilter(int Handle)
+{
+  if (!synthTuner->CloseFilter(Handle))
+     close(Handle);
+}
+
+bool cSynthDevice::OpenDvr(void)
+{
+  CloseDvr();
+  int fd_dvr = synthTuner->OpenDvr();
+  if (fd_dvr >= 0)
+     tsBuffer = new cTSBuffer(fd_dvr, MEGABYTE(2), CardIndex() + 1);
+  return fd_dvr >= 0;
+}
+
+void cSynthDevice::CloseDvr(void)
+{
+  if (tsBuffer) {
+     DELETENULL(tsBuffer);
+     synthTuner->CloseDvr();
+     }
+}
+
+bool cSynthDevice::GetTSPacket(uchar *&Data)
+{
+  if (tsBuffer) {
+     Data = tsBuffer->Get();
+     return true;
+     }
+  return false;
+}
+
+bool cSynthDevice::GetTSPackets(uchar *&Data, int &Count, int MaxCount)
+{
+  if (tsBuffer) {
+     Data = tsBuffer->Get(Count, MaxCount);
+     return true;
+     }
+  return false;
+}
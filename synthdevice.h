@@ -0,0 +1,120 @@
+/*
+ * synthdevice.h: A synthetic device for load testing
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __SYNTHDEVICE_H
+#define __SYNTHDEVICE_H
+
+#include "device.h"
+#include "remux.h"
+
+#define MAXSYNTHDEVICES 8
+
+/// A cSynthStream holds a transport stream in memory, which is either
+/// loaded from a file or generated.
+
+class cSynthStream {
+private:
+  uchar *data;
+  int size;
+  int length;
+  int duration;
+  int counter[3];
+  unsigned int seed;
+  char *name;
+  int vpid;
+  int apids[MAXTRACKS + 1];
+  int dpids[MAXTRACKS + 1];
+  void PutPes(int Pid, const uchar *Pes, int Length);
+  void PutVideoFrame(int Frame, int Length);
+  void PutAudioPacket(int Pid, int FrameSize, int Frames);
+public:
+  cSynthStream(const char *Name);
+  ~cSynthStream();
+  bool Generate(int Seconds, int VideoBitRate, bool Mpeg, bool Ac3);
+       ///< Generates Seconds of MPEG-2 video at the given bit rate (if it isn't
+       ///< 0), with an MPEG audio and/or AC3 track.
+  bool Load(const char *FileName, int MaxMB);
+       ///< Loads a TS file (like 001.ts of a TS recording), taking the PIDs from
+       ///< its PAT and PMT and the duration from its PCRs.
+  const char *Name(void) { return name; }
+  int Vpid(void) { return vpid; }
+  const int *Apids(void) { return apids; }
+  const int *Dpids(void) { return dpids; }
+  const uchar *Data(void) { return data; }
+  int Length(void) { return length; }
+  int Packets(void) { return length / TS_SIZE; }
+  int Duration(void) { return duration; }
+       ///< Returns the playing time of the stream in milliseconds, or 0 if it
+       ///< is unknown.
+  };
+
+class cSynthTuner;
+
+/// The cSynthDevice replays a transport stream (from a file or generated) in
+/// a loop, at real time or any other rate, as if it were received from a
+/// DVB device. It provides every channel and maps the stream's video and
+/// audio PIDs to the PIDs of the channels it is tuned to. SI data contained
+/// in the stream is delivered unchanged to the section filters. This allows
+/// load testing the receiving, recording and transfer paths without any
+/// DVB hardware.
+
+class cSynthDevice : public cDevice {
+private:
+  static cStringList specs;
+public:
+  static bool SetSpec(const char *Spec);
+         ///< Adds a synthetic device, defined by Spec, which is
+         ///< "FILE[,SPEED[,LOSS]]". FILE is a TS file (or '-' for a generated
+         ///< multiplex), SPEED is the replay rate relative to real time (0 =
+         ///< as fast as possible) and LOSS the percentage of TS packets that
+         ///< shall be dropped.
+         ///< \return False if Spec is invalid.
+  static bool Initialize(void);
+         ///< Initializes the synthetic devices defined by SetSpec().
+         ///< \return True if any devices are available.
+private:
+  cSynthTuner *synthTuner;
+  cTSBuffer *tsBuffer;
+  cSynthDevice(cSynthStream *Stream, double Speed, double Loss);
+public:
+  virtual ~cSynthDevice();
+
+// Channel facilities
+
+public:
+  virtual bool ProvidesSource(int Source) const;
+  virtual bool ProvidesTransponder(const cChannel *Channel) const;
+  virtual bool ProvidesChannel(const cChannel *Channel, int Priority = -1, bool *NeedsDetachReceivers = NULL) const;
+  virtual bool IsTunedToTransponder(const cChannel *Channel);
+protected:
+  virtual bool SetChannelDevice(const cChannel *Channel, bool LiveView);
+public:
+  virtual bool HasLock(int TimeoutMs = 0);
+
+// PID handle facilities
+
+protected:
+  virtual bool SetPid(cPidHandle *Handle, int Type, bool On);
+
+// Section filter facilities
+
+protected:
+  virtual int OpenFilter(u_short Pid, u_char Tid, u_char Mask);
+  virtual void CloseFilter(int Handle);
+
+// Receiver facilities
+
+protected:
+  virtual bool OpenDvr(void);
+  virtual void CloseDvr(void);
+  virtual bool GetTSPacket(uchar *&Data);
+  virtual bool GetTSPackets(uchar *&Data, int &Count, int MaxCount);
+  };
+
+#endif //__SYNTHDEVICE_H
@@ -26,6 +26,7 @@ extern "C" {
 #include <unistd.h>
 #include <utime.h>
 #include "i18n.h"
+#include "metrics.h"
 #include "thread.h"
 
 int SysLogLevel = 3;
@@ -292,17 +293,65 @@ bool EntriesOnSameFileSystem(const char *File1, const char *File2)
   return false;
 }
 
+// The disk space is checked frequently (by the recorders, the menus, and
+// whenever a recording is started or cut), so statfs() results are kept
+// for a short while:
+#define DISKSPACECACHESIZE  8
+#define DISKSPACECACHETTL   2000 // ms
+
+struct tDiskSpace {
+  char *directory;
+  uint64_t time;
+  int freeMB;
+  int usedMB;
+  };
+
+static tDiskSpace DiskSpaceCache[DISKSPACECACHESIZE] = { { NULL } };
+static cMutex DiskSpaceMutex;
+
+static void ClearDiskSpaceCache(void)
+{
+  cMutexLock MutexLock(&DiskSpaceMutex);
+  for (int i = 0; i < DISKSPACECACHESIZE; i++)
+      DiskSpaceCache[i].time = 0;
+}
+
 int FreeDiskSpaceMB(const char *Directory, int *UsedMB)
 {
+  cMutexLock MutexLock(&DiskSpaceMutex);
+  uint64_t Now = cTimeMs::Now();
+  tDiskSpace *ds = &DiskSpaceCache[0];
+  for (int i = 0; i < DISKSPACECACHESIZE; i++) {
+      tDiskSpace *p = &DiskSpaceCache[i];
+      if (p->directory && strcmp(p->directory, Directory) == 0) {
+         if (p->time && Now - p->time < DISKSPACECACHETTL) {
+            if (UsedMB)
+               *UsedMB = p->usedMB;
+            return p->freeMB;
+            }
+         ds = p;
+         break;
+         }
+      if (p->time < ds->time)
+         ds = p; // the least recently refreshed one will be replaced
+      }
   if (UsedMB)
      *UsedMB = 0;
   int Free = 0;
   struct statfs statFs;
   if (statfs(Directory, &statFs) == 0) {
      double blocksPerMeg = 1024.0 * 1024.0 / statFs.f_bsize;
+     int Used = int((statFs.f_blocks - statFs.f_bfree) / blocksPerMeg);
      if (UsedMB)
-        *UsedMB = int((statFs.f_blocks - statFs.f_bfree) / blocksPerMeg);
+        *UsedMB = Used;
      Free = int(statFs.f_bavail / blocksPerMeg);
+     if (!ds->directory || strcmp(ds->directory, Directory) != 0) {
+        free(ds->directory);
+        ds->directory = strdup(Directory);
+        }
+     ds->time = Now;
+     ds->freeMB = Free;
+     ds->usedMB = Used;
      }
   else
      LOG_ERROR_STR(Directory);
@@ -400,6 +449,7 @@ bool RemoveFileOrDir(const char *FileName, bool FollowSymlinks)
         LOG_ERROR_STR(FileName);
         return false;
         }
+     ClearDiskSpaceCache();
      }
   else if (errno != ENOENT) {
      LOG_ERROR_STR(FileName);
@@ -1437,6 +1487,369 @@ bool cSafeFile::Close(void)
   return result;
 }
 
+// --- cWriteBehind ----------------------------------------------------------
+
+#define DIRECTIOALIGN  KILOBYTE(4) // alignment of buffers, sizes and offsets for O_DIRECT
+#define PARTIALWRITEMS 1000 // ms after which the data in a partly filled buffer is written
+
+class cWriteBehind : public cListObject {
+  friend class cWriteScheduler;
+private:
+  int fd;
+  char *description;
+  bool direct;
+  int numBuffers;
+  int bufferSize;
+  uchar *buffers;
+  int next;      // the buffer that will be written next
+  int pending;   // the number of full buffers waiting to be written
+  int current;   // the buffer that is currently being filled
+  int fill;      // the number of bytes in buffer 'current'
+  int visible;   // the number of bytes in buffer 'current' the scheduler may write
+  uint64_t partialSince; // when data was first put into buffer 'current' (0 = empty)
+  int written;   // the number of bytes at the beginning of buffer 'next' that have already been written
+  bool busy;     // the scheduler is currently writing some of our buffers
+  off_t offset;  // the file offset of buffer 'next'
+  off_t dropped; // the file offset up to which the page cache has been dropped
+  int error;
+  // Statistics:
+  int maxPending;
+  int writes;
+  uint64_t writeMs;
+  int maxWriteMs;
+  int64_t bytesWritten;
+  static bool WriteAt(int Fd, const uchar *Data, int Size, off_t Offset);
+  int PartialEnd(uint64_t Now);
+       ///< Returns the end of the data in the partly filled buffer 'current'
+       ///< that is due to be written now, or 0 if there is none.
+public:
+  cWriteBehind(int Fd, int Buffers, int BufferSize, const char *Description);
+  ~cWriteBehind();
+  bool Ok(void) { return buffers != NULL; }
+  ssize_t Write(const void *Data, size_t Size);
+  bool Flush(void);
+       ///< Waits until all data has been written and detaches from the scheduler.
+  };
+
+// --- cWriteScheduler -------------------------------------------------------
+
+static cMetricHistogram WriteLatency("writer.latency_ms");
+static cMetricCounter WriteBytes("writer.bytes");
+
+// A single thread that writes the data of all cWriteBehind objects.
+// Each file in turn gets all of its currently pending buffers written
+// in one large chunk, so that concurrent recordings don't keep the disk
+// seeking between many small interleaved writes. If a file has no full
+// buffers, the data in its partly filled buffer is written once it is
+// PARTIALWRITEMS old, so that a recording can be replayed up to its end
+// while it is still being written. The rest of that buffer is written
+// when it is full.
+
+class cWriteScheduler : public cThread {
+private:
+  cMutex mutex;
+  cCondVar work, done;
+  cList<cWriteBehind> files;
+  cWriteBehind *current;
+  static cWriteScheduler *scheduler;
+  virtual void Action(void);
+  cWriteBehind *NextPending(void);
+public:
+  cWriteScheduler(void);
+  static cWriteScheduler *Scheduler(void);
+  void Lock(void) { mutex.Lock(); }
+  void Unlock(void) { mutex.Unlock(); }
+  void Add(cWriteBehind *WriteBehind);
+  void Del(cWriteBehind *WriteBehind);
+  void Queue(void) { work.Broadcast(); }
+       ///< Tells the thread that there are new pending buffers.
+  void Wait(void) { done.TimedWait(mutex, 100); }
+       ///< Waits for the thread to finish writing a chunk (must be locked).
+  static int Status(cStringList &Lines);
+  };
+
+cWriteScheduler *cWriteScheduler::scheduler = NULL;
+
+cWriteScheduler::cWriteScheduler(void)
+:cThread("write scheduler")
+{
+  current = NULL;
+}
+
+cWriteScheduler *cWriteScheduler::Scheduler(void)
+{
+  static cMutex Mutex;
+  cMutexLock MutexLock(&Mutex);
+  if (!scheduler) {
+     scheduler = new cWriteScheduler;
+     scheduler->Start();
+     }
+  return scheduler;
+}
+
+void cWriteScheduler::Add(cWriteBehind *WriteBehind)
+{
+  cMutexLock MutexLock(&mutex);
+  files.Add(WriteBehind);
+}
+
+void cWriteScheduler::Del(cWriteBehind *WriteBehind)
+{
+  cMutexLock MutexLock(&mutex);
+  while (WriteBehind->busy)
+        done.TimedWait(mutex, 100);
+  if (current == WriteBehind)
+     current = NULL;
+  files.Del(WriteBehind, false);
+}
+
+cWriteBehind *cWriteScheduler::NextPending(void)
+{
+  // Round robin, starting after the file we have written last:
+  cWriteBehind *wb = current ? files.Next(current) : NULL;
+  uint64_t Now = cTimeMs::Now();
+  for (int i = files.Count(); i-- > 0; wb = files.Next(wb)) {
+      if (!wb)
+         wb = files.First();
+      if ((wb->pending || wb->PartialEnd(Now)) && !wb->error)
+         return current = wb;
+      }
+  return NULL;
+}
+
+void cWriteScheduler::Action(void)
+{
+  mutex.Lock();
+  while (Running()) {
+        cWriteBehind *wb = NextPending();
+        if (!wb) {
+           work.TimedWait(mutex, 100);
+           continue;
+           }
+        // All pending buffers up to the end of the buffer ring are
+        // consecutive both in memory and in the file. Without any pending
+        // buffers, buffer 'next' is the partly filled one:
+        int n = min(wb->pending, wb->numBuffers - wb->next);
+        int Start = wb->direct ? wb->written / DIRECTIOALIGN * DIRECTIOALIGN : wb->written;
+        int End = n ? n * wb->bufferSize : wb->PartialEnd(cTimeMs::Now());
+        // O_DIRECT can only write whole blocks, so an incomplete last block is
+        // written through the page cache (and written again once it is full):
+        bool Buffered = wb->direct && End % DIRECTIOALIGN;
+        const uchar *b = wb->buffers + wb->next * wb->bufferSize + Start;
+        int Size = End - Start;
+        int New = End - wb->written; // the rest has been written before
+        off_t o = wb->offset + Start;
+        wb->busy = true;
+        mutex.Unlock();
+        cTimeMs t;
+        int Flags = Buffered ? fcntl(wb->fd, F_GETFL) : -1;
+        if (Flags >= 0)
+           fcntl(wb->fd, F_SETFL, Flags & ~O_DIRECT);
+        bool ok = cWriteBehind::WriteAt(wb->fd, b, Size, o);
+        int e = errno;
+        if (Flags >= 0)
+           fcntl(wb->fd, F_SETFL, Flags);
+        int ms = t.Elapsed();
+        if (ok && !wb->direct && o > wb->dropped) {
+           // Drop what we have written before this chunk, which has most
+           // likely been written back to disk by now:
+           posix_fadvise(wb->fd, wb->dropped, o - wb->dropped, POSIX_FADV_DONTNEED);
+           wb->dropped = o;
+           }
+        mutex.Lock();
+        if (!ok && !wb->error)
+           wb->error = e;
+        if (n) {
+           wb->next = (wb->next + n) % wb->numBuffers;
+           wb->pending -= n;
+           wb->offset += End;
+           wb->written = 0;
+           }
+        else {
+           wb->written = End;
+           if (!wb->pending) // otherwise the buffer has been filled up in the meantime
+              wb->partialSince = wb->visible > End ? cTimeMs::Now() : 0;
+           }
+        wb->busy = false;
+        wb->writes++;
+        wb->writeMs += ms;
+        wb->maxWriteMs = max(wb->maxWriteMs, ms);
+        WriteLatency.Observe(ms);
+        if (ok) {
+           wb->bytesWritten += New;
+           WriteBytes.Add(New);
+           }
+        done.Broadcast();
+        }
+  mutex.Unlock();
+}
+
+int cWriteScheduler::Status(cStringList &Lines)
+{
+  if (!scheduler)
+     return Lines.Size();
+  cMutexLock MutexLock(&scheduler->mutex);
+  for (cWriteBehind *wb = scheduler->files.First(); wb; wb = scheduler->files.Next(wb)) {
+      int Capacity = wb->numBuffers * wb->bufferSize;
+      int Fill = wb->pending * wb->bufferSize + wb->fill;
+      cString s = cString::sprintf("%s fill %d%% max %d%% latency %dms max %dms written %dMB%s",
+                                   wb->description,
+                                   int(Fill * 100LL / Capacity),
+                                   int(wb->maxPending * wb->bufferSize * 100LL / Capacity),
+                                   wb->writes ? int(wb->writeMs / wb->writes) : 0,
+                                   wb->maxWriteMs,
+                                   int(wb->bytesWritten / MEGABYTE(1)),
+                                   wb->error ? " error" : "");
+      Lines.Append(strdup(s));
+      }
+  return Lines.Size();
+}
+
+// --- cWriteBehind ----------------------------------------------------------
+
+cWriteBehind::cWriteBehind(int Fd, int Buffers, int BufferSize, const char *Description)
+{
+  fd = Fd;
+  description = strdup(Description ? Description : *cString::sprintf("file handle %d", Fd));
+  direct = false;
+  numBuffers = max(Buffers, 2);
+  bufferSize = (BufferSize + DIRECTIOALIGN - 1) / DIRECTIOALIGN * DIRECTIOALIGN;
+  buffers = NULL;
+  next = pending = current = fill = 0;
+  visible = written = 0;
+  partialSince = 0;
+  busy = false;
+  error = 0;
+  maxPending = 0;
+  writes = 0;
+  writeMs = 0;
+  maxWriteMs = 0;
+  bytesWritten = 0;
+  offset = dropped = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0)
+     return;
+  void *p = NULL;
+  if (posix_memalign(&p, DIRECTIOALIGN, numBuffers * bufferSize) == 0) {
+     buffers = (uchar *)p;
+     if (offset % DIRECTIOALIGN == 0) {
+        int Flags = fcntl(fd, F_GETFL);
+        direct = Flags >= 0 && fcntl(fd, F_SETFL, Flags | O_DIRECT) == 0;
+        }
+     if (!direct)
+        dsyslog("can't use O_DIRECT for %s - using buffered writes", description);
+     cWriteScheduler::Scheduler()->Add(this);
+     }
+  else
+     esyslog("ERROR: can't allocate %d write behind buffers of %d bytes", numBuffers, bufferSize);
+}
+
+cWriteBehind::~cWriteBehind()
+{
+  Flush();
+  free(description);
+}
+
+bool cWriteBehind::WriteAt(int Fd, const uchar *Data, int Size, off_t Offset)
+{
+  while (Size > 0) {
+        ssize_t w = pwrite(Fd, Data, Size, Offset);
+        if (w < 0) {
+           if (errno == EINTR)
+              continue;
+           return false;
+           }
+        Data += w;
+        Size -= w;
+        Offset += w;
+        }
+  return true;
+}
+
+int cWriteBehind::PartialEnd(uint64_t Now)
+{
+  if (pending || busy || !partialSince || Now - partialSince < PARTIALWRITEMS)
+     return 0;
+  return visible > written ? visible : 0;
+}
+
+ssize_t cWriteBehind::Write(const void *Data, size_t Size)
+{
+  cWriteScheduler *Scheduler = cWriteScheduler::Scheduler();
+  const uchar *d = (const uchar *)Data;
+  size_t Rest = Size;
+  while (Rest > 0) {
+        // The buffer being filled is never touched by the scheduler:
+        uchar *b = buffers + current * bufferSize;
+        int n = min(Rest, size_t(bufferSize - fill));
+        memcpy(b + fill, d, n);
+        fill += n;
+        d += n;
+        Rest -= n;
+        if (fill == bufferSize) {
+           Scheduler->Lock();
+           pending++;
+           maxPending = max(maxPending, pending);
+           current = (current + 1) % numBuffers;
+           fill = visible = 0;
+           partialSince = 0;
+           Scheduler->Queue();
+           while (pending == numBuffers && !error)
+                 Scheduler->Wait();
+           Scheduler->Unlock();
+           }
+        if (error) {
+           errno = error;
+           return -1;
+           }
+        }
+  if (fill) {
+     // Lets the scheduler write the data of the partly filled buffer, should
+     // no more data arrive for a while:
+     Scheduler->Lock();
+     visible = fill;
+     if (!partialSince)
+        partialSince = cTimeMs::Now();
+     Scheduler->Unlock();
+     }
+  return Size;
+}
+
+bool cWriteBehind::Flush(void)
+{
+  if (!buffers)
+     return true;
+  cWriteScheduler *Scheduler = cWriteScheduler::Scheduler();
+  Scheduler->Lock();
+  while ((pending || busy) && !error)
+        Scheduler->Wait();
+  Scheduler->Unlock();
+  Scheduler->Del(this);
+  if (direct) {
+     // O_DIRECT can't write the final partial buffer:
+     int Flags = fcntl(fd, F_GETFL);
+     if (Flags >= 0)
+        fcntl(fd, F_SETFL, Flags & ~O_DIRECT);
+     direct = false;
+     }
+  if (!error && fill > written) {
+     // Without any pending buffers, 'current' is 'next':
+     if (WriteAt(fd, buffers + current * bufferSize + written, fill - written, offset + written))
+        bytesWritten += fill - written;
+     else
+        error = errno;
+     }
+  offset += fill;
+  fill = written = 0;
+  lseek(fd, offset, SEEK_SET);
+  free(buffers);
+  buffers = NULL;
+  if (error) {
+     errno = error;
+     return false;
+     }
+  return true;
+}
+
 // --- cUnbufferedFile -------------------------------------------------------
 
 #define USE_FADVISE
@@ -1446,6 +1859,7 @@ bool cSafeFile::Close(void)
 cUnbufferedFile::cUnbufferedFile(void)
 {
   fd = -1;
+  writeBehind = NULL;
 }
 
 cUnbufferedFile::~cUnbufferedFile()
@@ -1473,6 +1887,12 @@ int cUnbufferedFile::Open(const char *FileName, int Flags, mode_t Mode)
 
 int cUnbufferedFile::Close(void)
 {
+  int WriteBehindError = 0;
+  if (writeBehind) {
+     if (!writeBehind->Flush())
+        WriteBehindError = errno;
+     DELETENULL(writeBehind);
+     }
 #ifdef USE_FADVISE
   if (fd >= 0) {
      if (totwritten)    // if we wrote anything make sure the data has hit the disk before
@@ -1482,7 +1902,12 @@ int cUnbufferedFile::Close(void)
 #endif
   int OldFd = fd;
   fd = -1;
-  return close(OldFd);
+  int Result = close(OldFd);
+  if (WriteBehindError) {
+     errno = WriteBehindError;
+     return -1;
+     }
+  return Result;
 }
 
 // When replaying and going e.g. FF->PLAY the position jumps back 2..8M
@@ -1569,8 +1994,25 @@ ssize_t cUnbufferedFile::Read(void *Data, size_t Size)
   return -1;
 }
 
+bool cUnbufferedFile::SetWriteBehind(int Buffers, int BufferSize, const char *Description)
+{
+  if (fd >= 0 && !writeBehind) {
+     writeBehind = new cWriteBehind(fd, Buffers, BufferSize, Description);
+     if (!writeBehind->Ok())
+        DELETENULL(writeBehind);
+     }
+  return writeBehind != NULL;
+}
+
+int cUnbufferedFile::WriteBehindStatus(cStringList &Lines)
+{
+  return cWriteScheduler::Status(Lines);
+}
+
 ssize_t cUnbufferedFile::Write(const void *Data, size_t Size)
 {
+  if (writeBehind)
+     return writeBehind->Write(Data, Size);
   if (fd >=0) {
      ssize_t bytesWritten = safe_write(fd, Data, Size);
 #ifdef USE_FADVISE
@@ -196,6 +196,9 @@ cString itoa(int n);
 cString AddDirectory(const char *DirName, const char *FileName);
 bool EntriesOnSameFileSystem(const char *File1, const char *File2);
 int FreeDiskSpaceMB(const char *Directory, int *UsedMB = NULL);
+    ///< Returns the free disk space (and optionally the used disk space) of the
+    ///< file system Directory is on. The results are cached for a few seconds,
+    ///< and the cache is cleared whenever RemoveFileOrDir() removes something.
 bool DirectoryOk(const char *DirName, bool LogErrors = false);
 bool MakeDirs(const char *FileName, bool IsDirectory = false);
 bool RemoveFileOrDir(const char *FileName, bool FollowSymlinks = false);
@@ -330,6 +333,9 @@ public:
 /// cUnbufferedFile is used for large files that are mainly written or read
 /// in a streaming manner, and thus should not be cached.
 
+class cStringList;
+class cWriteBehind;
+
 class cUnbufferedFile {
 private:
   int fd;
@@ -342,6 +348,7 @@ private:
   size_t readahead;
   size_t written;
   size_t totwritten;
+  cWriteBehind *writeBehind;
   int FadviseDrop(off_t Offset, off_t Len);
 public:
   cUnbufferedFile(void);
@@ -352,6 +359,29 @@ public:
   off_t Seek(off_t Offset, int Whence);
   ssize_t Read(void *Data, size_t Size);
   ssize_t Write(const void *Data, size_t Size);
+  bool SetWriteBehind(int Buffers, int BufferSize, const char *Description = NULL);
+       ///< Makes all following Write() calls asynchronous. The data is collected
+       ///< in Buffers buffers of BufferSize bytes each (which must be a multiple
+       ///< of the page size). A single scheduler thread, which is shared by all
+       ///< files in write behind mode, writes the full buffers of each file in
+       ///< turn, each time as one large chunk. The page cache is bypassed
+       ///< (O_DIRECT) if the file system supports it. Write() only blocks if all
+       ///< buffers are waiting to be written. Data that has been sitting in a
+       ///< partly filled buffer for about a second is written, too, so that the
+       ///< file can be read while it is being written (as when replaying a
+       ///< recording that is still going on). Description is used to identify
+       ///< the file in WriteBehindStatus().
+       ///< Once this has been called, the file may only be written sequentially
+       ///< (no Read() or Seek()) until it is closed. Close() writes any remaining
+       ///< data. Errors from the background writes are reported by the next call
+       ///< to Write() or Close().
+       ///< Returns false if the write behind buffers can't be set up, in which
+       ///< case the file continues to be written synchronously.
+  static int WriteBehindStatus(cStringList &Lines);
+       ///< Appends one line per file in write behind mode to Lines, telling the
+       ///< current and maximum fill level of its buffers, the average and maximum
+       ///< time it took to write a chunk, and the amount of data written.
+       ///< Returns the total number of lines in Lines.
   static cUnbufferedFile *Create(const char *FileName, int Flags, mode_t Mode = DEFFILEMODE);
   };
 
@@ -454,7 +484,8 @@ public:
   virtual void Insert(T Data, int Before = 0)
   {
     if (Before < size) {
-       Realloc(size);
+       if (size >= allocated)
+          Realloc(allocated * 3 / 2); // increase size by 50%
        memmove(&data[Before + 1], &data[Before], (size - Before) * sizeof(T));
        size++;
        data[Before] = Data;
@@ -471,7 +502,7 @@ public:
   virtual void Remove(int Index)
   {
     if (Index < size - 1)
-       memmove(&data[Index], &data[Index + 1], (size - Index) * sizeof(T));
+       memmove(&data[Index], &data[Index + 1], (size - Index - 1) * sizeof(T));
     size--;
   }
   virtual void Clear(void)
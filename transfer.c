@@ -19,6 +19,7 @@ cTransfer::cTransfer(tChannelID ChannelID, int VPid, const int *APids, const int
 ,cThread("transfer")
 {
   ringBuffer = new cRingBufferLinear(TRANSFERBUFSIZE, TS_SIZE * 2, true, "Transfer");
+  ringBuffer->SetSingleProducerConsumer();
   remux = new cRemux(VPid, APids, Setup.UseDolbyDigital ? DPids : NULL, SPids);
 }
 
@@ -23,6 +23,7 @@ private:
 protected:
   virtual void Activate(bool On);
   virtual void Receive(uchar *Data, int Length);
+  virtual void ReceiveBatch(uchar **Data, int Count) { ReceiveContiguous(Data, Count); }
   virtual void Action(void);
 public:
   cTransfer(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids);
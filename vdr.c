@@ -51,6 +51,7 @@
 #include "libsi/si.h"
 #include "lirc.h"
 #include "menu.h"
+#include "metrics.h"
 #include "osdbase.h"
 #include "plugin.h"
 #include "rcu.h"
@@ -59,6 +60,7 @@
 #include "skinclassic.h"
 #include "skinsttng.h"
 #include "sources.h"
+#include "synthdevice.h"
 #include "themes.h"
 #include "timers.h"
 #include "tools.h"
@@ -237,6 +239,7 @@ int main(int argc, char *argv[])
       { "rcu",      optional_argument, NULL, 'r' | 0x100 },
       { "record",   required_argument, NULL, 'r' },
       { "shutdown", required_argument, NULL, 's' },
+      { "synth",    required_argument, NULL, 's' | 0x100 },
       { "terminal", required_argument, NULL, 't' },
       { "user",     required_argument, NULL, 'u' },
       { "userdump", no_argument,       NULL, 'u' | 0x100 },
@@ -336,6 +339,12 @@ int main(int argc, char *argv[])
                     break;
           case 's': ShutdownHandler.SetShutdownCommand(optarg);
                     break;
+          case 's' | 0x100:
+                    if (!cSynthDevice::SetSpec(optarg)) {
+                       fprintf(stderr, "vdr: invalid synthetic device: %s\n", optarg);
+                       return 2;
+                       }
+                    break;
           case 't': Terminal = optarg;
                     if (access(Terminal, R_OK | W_OK) < 0) {
                        fprintf(stderr, "vdr: can't access terminal: %s\n", Terminal);
@@ -430,6 +439,13 @@ int main(int argc, char *argv[])
                "                           (default: %s)\n"
                "  -r CMD,   --record=CMD   call CMD before and after a recording\n"
                "  -s CMD,   --shutdown=CMD call CMD to shutdown the computer\n"
+               "            --synth=SPEC   add a synthetic device for load testing, which\n"
+               "                           replays a TS file in a loop; SPEC is\n"
+               "                           FILE[,SPEED[,LOSS]], where FILE '-' generates a\n"
+               "                           multiplex, SPEED is relative to real time (default:\n"
+               "                           1, 0 = as fast as possible) and LOSS is the\n"
+               "                           percentage of TS packets to drop (default: 0);\n"
+               "                           there may be up to %d --synth options\n"
                "  -t TTY,   --terminal=TTY controlling tty\n"
                "  -u USER,  --user=USER    run as user USER; only applicable if started as\n"
                "                           root\n"
@@ -448,6 +464,7 @@ int main(int argc, char *argv[])
                LOCDIR,
                DEFAULTSVDRPPORT,
                RCU_DEVICE,
+               MAXSYNTHDEVICES,
                VideoDirectory,
                DEFAULTWATCHDOG
                );
@@ -605,6 +622,7 @@ int main(int argc, char *argv[])
   // DVB interfaces:
 
   cDvbDevice::Initialize();
+  cSynthDevice::Initialize();
 
   // Initialize plugins:
 
@@ -750,6 +768,14 @@ int main(int argc, char *argv[])
               dsyslog("max. latency time %d seconds", MaxLatencyTime);
               }
            }
+        // Log the metrics:
+        if (Setup.MetricsLogInterval > 0) {
+           static time_t LastMetricsLog = 0;
+           if (Now - LastMetricsLog >= Setup.MetricsLogInterval) {
+              cMetrics::Log();
+              LastMetricsLog = Now;
+              }
+           }
         // Handle channel and timer modifications:
         if (!Channels.BeingEdited() && !Timers.BeingEdited()) {
            int modified = Channels.Modified();
@@ -891,9 +917,13 @@ int main(int argc, char *argv[])
            // Delete expired timers:
            Timers.DeleteExpired();
            }
-        if (!Menu && Recordings.NeedsUpdate()) {
-           Recordings.Update();
-           DeletedRecordings.Update();
+        if (!Menu) {
+           Recordings.ApplyChanges();
+           DeletedRecordings.ApplyChanges();
+           if (Recordings.NeedsUpdate()) {
+              Recordings.Update();
+              DeletedRecordings.Update();
+              }
            }
         // CAM control:
         if (!Menu && !cOsd::IsOpen())